@@ -2,10 +2,40 @@
 #define NOB_STRIP_PREFIX
 #include "dep/nob/nob.h"
 
+// Tests are in tests, every one is a program that returns nonzero on failure.
+static char const *tests[] = {
+	"alloc",
+	"ellipse_precision",
+	"fast_math",
+	"load_corrupted",
+};
+
+static bool run_tests(Cmd *cmd) {
+	bool ok = true;
+	for (size_t i = 0; i < ARRAY_LEN(tests); ++i) {
+		//cmd_append(cmd, "g++", temp_sprintf("tests/%s.cpp", tests[i]), "-std=c++20", "-O2", "-o", temp_sprintf("tests/%s", tests[i]));
+		cmd_append(cmd, "cl", temp_sprintf("tests/%s.cpp", tests[i]), "/O2", "/std:c++20", "/EHsc", temp_sprintf("/Fo:tests/%s.obj", tests[i]), "/link", temp_sprintf("/out:tests/%s.exe", tests[i]));
+		if (!cmd_run_sync_and_reset(cmd))
+			return false;
+
+		cmd_append(cmd, temp_sprintf("tests/%s.exe", tests[i]));
+		if (!cmd_run_sync_and_reset(cmd)) {
+			nob_log(ERROR, "test %s failed", tests[i]);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
 int main(int argc, char **argv) {
 	NOB_GO_REBUILD_URSELF(argc, argv);
 
 	Cmd cmd = {};
+
+	// ./nob test builds and runs the tests instead of the example.
+	if (argc > 1 && strcmp(argv[1], "test") == 0)
+		return run_tests(&cmd) ? 0 : 1;
+
 	//cmd_append(&cmd, "g++", "example/main.cpp", "-o", "example/main");
 	cmd_append(&cmd, "cl", "example/main.cpp", "/Zi", "/std:c++20", "/EHsc", "/link", "/out:example/main.exe");
 	if (!cmd_run_sync_and_reset(&cmd))
@@ -1,16 +1,24 @@
 #ifndef SDFD_H_
 #define SDFD_H_
 #include <vector>
+#include <memory>
 #include <optional>
+#include <span>
 #include <stdint.h>
+#include <stdio.h>
 #include <math.h>
 
-#define SDFD_VERSION 0
+// Files are read if their version is not newer than this.
+// 2 added offsets of objects, see load_object.
+#define SDFD_VERSION 2
 
 #ifndef SDFD_DEF
 #define SDFD_DEF extern
 #endif
 
+// Define SDFD_NO_SIMD to use only scalar code in batch evaluators.
+// Otherwise on x86 SSE2, AVX2 or AVX-512 kernels are selected at runtime.
+
 namespace sdfd {
 
 
@@ -85,6 +93,34 @@ struct Ellipse {
 
 SDFD_DEF float distance(Ellipse e, Vector2 p);
 
+// How accurately distances to ellipses are computed, they are by far the most
+// expensive primitive. Everything else is always exact.
+enum class EvalPrecision : uint8_t {
+	// distance(Ellipse).
+	exact,
+
+	// distance_fast.
+	fast,
+
+	// distance_bound.
+	bound,
+};
+
+// Same solver as distance(Ellipse), but with polynomial acos, cos, sin and cube
+// root, written so that batch evaluators run it on SIMD lanes, where it is about
+// 10 times faster. Differs from it by less than
+// 2e-5 * (max(1, |distance|) + max(radius.x, radius.y)), below 1/64 of a pixel
+// near the edge when distance is in pixels and radii are below 500 pixels.
+SDFD_DEF float distance_fast(Ellipse e, Vector2 p);
+
+// (length((p - center) / radius) - 1) * min(radius.x, radius.y).
+// Never bigger in magnitude than the distance and changes no faster than the
+// point moves, so it is safe for culling and stepping, but it is much smaller
+// than the distance far from the ellipse, especially a long one.
+SDFD_DEF float distance_bound(Ellipse e, Vector2 p);
+
+SDFD_DEF float distance(Ellipse e, Vector2 p, EvalPrecision precision);
+
 
 /*
 #define x(type, name, kind_value)
@@ -135,9 +171,12 @@ SDFD_ENUMERATE_OPERATION(x)
 #undef x
 */
 #define SDFD_ENUMERATE_OPERATION(x) \
-	x(min, 0, 2) /* minimum */ \
-	x(max, 1, 2) /* maximum */ \
-	x(neg, 2, 1) /* negate  */ \
+	x(min,       0, 2) /* minimum */ \
+	x(max,       1, 2) /* maximum */ \
+	x(neg,       2, 1) /* negate  */ \
+	x(min_range, 3, 2) /* minimum of args[0] to args[1] */ \
+	x(max_range, 4, 2) /* maximum of args[0] to args[1] */ \
+	x(max_neg,   5, 2) /* maximum of args[0] and -args[1], difference of shapes */ \
 
 struct Operation {
 	enum class Kind : uint16_t {
@@ -151,6 +190,9 @@ struct Operation {
 	// Indices into Object::primitives, Scene::primitives or Object::operations.
 	// If kind is object_operation, index must be of a previous operation, otherwise
 	// it will evaluate to NaN.
+	// min_range and max_range read every index from args[0] to args[1] and fold
+	// them from the left, exactly like a chain of min or max would. Both must have
+	// the same kind and args[0] must not be after args[1], otherwise it evaluates to NaN.
 	ArgumentIndex args[2] = {};
 };
 
@@ -167,24 +209,646 @@ struct Scene {
 	Vector2 scale = {1, 1};
 };
 
+// Scene is written to a new file next to path, which is flushed to disk and
+// renamed to path once it is complete, so path has either the old or the new
+// scene, even after a crash.
 SDFD_DEF bool store_to_file(Scene const &scene, char const *path);
 SDFD_DEF std::optional<Scene> load_from_file(char const *path);
 
+// Same as above with contents of the file in memory. buffer is resized to fit
+// the scene, reusing its storage.
+SDFD_DEF bool store_to_memory(Scene const &scene, std::vector<uint8_t> &buffer);
+SDFD_DEF std::optional<Scene> load_from_memory(std::span<uint8_t const> data);
+
+// Loads only object with index from file. Files since version 2 store offsets
+// of objects after their count, so this reads the header, two offsets and the
+// object. Older files are read up to the object.
+// Each call opens the file, so objects can be loaded by multiple threads.
+// Returns empty optional if there is no such object or the file is not valid.
+SDFD_DEF std::optional<Object> load_object(char const *path, uint32_t index);
+
+// Object stored in a SceneView, fields point into the mapped file.
+// Primitives and operations take a different number of bytes depending on
+// their kind and are not aligned, so they are read with read_object.
+struct ObjectView {
+	uint8_t const *primitives = nullptr;
+	uint32_t primitive_count = 0;
+
+	uint8_t const *operations = nullptr;
+	uint32_t operation_count = 0;
+
+	// Where the next object starts.
+	uint8_t const *end = nullptr;
+};
+
+// Read-only scene in a memory mapped file. Opening it checks that the file is
+// well formed, but copies and allocates nothing, so only pages of objects that
+// are used are read from disk.
+struct SceneView {
+	// Unmapped when the view is destroyed.
+	struct Mapping {
+		uint8_t const *data = nullptr;
+		std::size_t size = 0;
+
+		Mapping() = default;
+		Mapping(Mapping &&that);
+		Mapping &operator=(Mapping &&that);
+		~Mapping();
+	};
+	Mapping mapping;
+
+	// Stored objects, see next_object.
+	uint32_t object_count = 0;
+	uint8_t const *objects_begin = nullptr;
+	uint8_t const *objects_end = nullptr;
+
+	// object_count + 1 unaligned uint64_t offsets from the start of the file,
+	// the last one is objects_end. Null in files older than version 2.
+	uint8_t const *offsets = nullptr;
+
+	// Stored Scene::primitives, see read_primitives.
+	uint32_t primitive_count = 0;
+	uint8_t const *primitives = nullptr;
+
+	// Not stored in the file, same as Scene::scale.
+	Vector2 scale = {1, 1};
+
+	// Different for every mapped file, even if it is mapped at the same address
+	// as one that was unmapped.
+	uint64_t id = 0;
+};
+
+// Returns empty optional if the file can not be mapped or is not a valid scene.
+SDFD_DEF std::optional<SceneView> map_scene(char const *path);
+
+// Moves object to the first stored object if it is empty, otherwise to the one
+// after it. Returns false after the last one.
+//     sdfd::ObjectView object;
+//     while (sdfd::next_object(view, object)) { ... }
+SDFD_DEF bool next_object(SceneView const &view, ObjectView &object);
+
+// Finds object with index, returns false if index is not less than object_count.
+// Without offsets objects before it are walked.
+SDFD_DEF bool get_object(SceneView const &view, uint32_t index, ObjectView &object);
+
+// Copies stored object or primitives into vectors, reusing their storage.
+SDFD_DEF void read_object(ObjectView view, Object &object);
+SDFD_DEF void read_primitives(SceneView const &view, std::vector<Primitive> &primitives);
+
+enum class ReadStatus : uint8_t {
+	// Next object is in SceneReader::object.
+	object,
+
+	// All objects were read, Scene::primitives are in SceneReader::primitives.
+	end,
+
+	// Source has no data right now, call next_object again when it has more.
+	pending,
+
+	// Source failed or data is not a valid scene.
+	failed,
+};
+
+// Reads objects of a scene from a stream one at a time, keeping only a fixed
+// size buffer and the current object in memory. Parsing stops where input runs
+// out and continues from there on the next call, so sources don't have to be
+// seekable or blocking.
+struct SceneReader {
+	// Stores up to size bytes at data and returns how many were stored, 0 at the
+	// end of input, read_pending if no bytes are available yet or read_failed.
+	// source is passed to it as is.
+	std::ptrdiff_t (*read)(void *source, void *data, std::size_t size) = nullptr;
+	void *source = nullptr;
+
+	inline static constexpr std::ptrdiff_t read_pending = -1;
+	inline static constexpr std::ptrdiff_t read_failed = -2;
+
+	// Storage is reused for every object.
+	Object object;
+	std::vector<Primitive> primitives;
+
+	// Bytes that were read but not parsed yet are from buffer_begin to buffer_end.
+	std::vector<uint8_t> buffer;
+	std::size_t buffer_begin = 0;
+	std::size_t buffer_end = 0;
+
+	enum class Stage : uint8_t {
+		header,
+		object_count,
+		offsets,
+		primitive_count,
+		primitives,
+		operation_count,
+		operations,
+		scene_primitive_count,
+		scene_primitives,
+		end,
+		failed,
+	};
+	Stage stage = Stage::header;
+	uint16_t version = 0;
+	uint32_t objects_left = 0;
+	uint32_t items_left = 0;
+};
+
+// Reader of a FILE * or a file descriptor, which can be non-blocking.
+// Neither is closed by the reader.
+SDFD_DEF SceneReader make_scene_reader(FILE *file, std::size_t buffer_size = 1 << 16);
+SDFD_DEF SceneReader make_scene_reader(int fd, std::size_t buffer_size = 1 << 16);
+
+// Reads until the next object, the end of the scene or until the source has
+// no more data. After end or failed it keeps returning the same.
+SDFD_DEF ReadStatus next_object(SceneReader &reader);
+
+// Axis aligned rectangle.
+struct Rect {
+	Vector2 min;
+	Vector2 max;
+};
+
+// Range of values, both ends included.
+struct Interval {
+	float min;
+	float max;
+};
+
+// Object lowered to primitives stored by kind and a flat list of instructions
+// that combine them. Meant for objects that are evaluated a lot but rarely changed.
+// Scene scale is baked into the program, so it has to be compiled again if the
+// scale or the object changes.
+struct Program {
+	// Primitives are stored as arrays of their fields, one set of arrays per kind.
+	// Every primitive gets its own register: constants come first, then planes,
+	// circles and ellipses.
+	struct Planes {
+		std::vector<float> normal_x;
+		std::vector<float> normal_y;
+		std::vector<float> offset;
+	};
+	struct Circles {
+		std::vector<float> center_x;
+		std::vector<float> center_y;
+		std::vector<float> radius;
+	};
+	struct Ellipses {
+		std::vector<float> center_x;
+		std::vector<float> center_y;
+		std::vector<float> radius_x;
+		std::vector<float> radius_y;
+	};
+
+	std::vector<float> constants;
+	Planes planes;
+	Circles circles;
+	Ellipses ellipses;
+
+	// Bounding volume hierarchy over the circles of a large union. They are not
+	// given registers, a min_bvh instruction finds the smallest distance by walking
+	// the tree and skipping nodes that can't be closer than the best one so far.
+	struct Bvh {
+		struct Node {
+			// Contains squares around primitives with their largest radius as half size.
+			Rect bounds;
+
+			// Distances of primitives in the node are at least min_ratio times the
+			// distance to bounds, and at least -max_depth inside of bounds.
+			float min_ratio;
+			float max_depth;
+
+			// Leaves have primitives from first to first + count, other nodes have
+			// children at first and first + 1 and count of zero.
+			uint32_t first;
+			uint32_t count;
+		};
+
+		std::vector<Node> nodes;
+
+		// Primitives in the order of leaves. They are circles when scale of
+		// the scene is uniform and ellipses otherwise.
+		Ellipses primitives;
+		bool is_circles = true;
+	};
+
+	// Shared so that specialized programs don't copy them.
+	std::vector<std::shared_ptr<Bvh const>> bvhs;
+
+	// Registers after the ones of primitives are reused once their value is no
+	// longer needed. This is how many registers primitives and instructions can use.
+	inline static constexpr uint32_t max_register_count = 1 << 16;
+
+	struct Instruction {
+		enum class Kind : uint8_t {
+			// Copy first source to destination.
+			copy,
+
+			// Store smallest distance of primitives of bvhs[sources[0]] into destination.
+			min_bvh,
+
+			// Apply operation to sources and store into destination. compile splits
+			// min_range and max_range into min and max, so that specialization can
+			// drop arguments one by one. Circles of large unions go to min_bvh instead.
+			#define x(name, value, arity) name,
+			SDFD_ENUMERATE_OPERATION(x)
+			#undef x
+		};
+
+		Kind kind = {};
+		uint16_t destination = 0;
+		uint16_t sources[2] = {};
+	};
+
+	std::vector<Instruction> instructions;
+
+	// Number of registers used by primitives and instructions.
+	uint32_t register_count = 0;
+
+	// Register that holds the distance after executing all instructions.
+	uint16_t result = 0;
+
+	// Used by ellipses.
+	EvalPrecision precision = EvalPrecision::exact;
+};
+
+// Reusable storage for evaluating objects.
+// Once it has grown to fit the biggest evaluated object, evaluating through
+// a context does not allocate.
+// A context must not be used by multiple threads at the same time.
+// Functions that don't take a context use one stored in thread local storage.
+struct EvalContext {
+	std::vector<float> operation_results;
+	std::vector<float> batch_rows;
+	std::vector<Interval> operation_intervals;
+	std::vector<Rect> operation_bounds;
+	std::vector<float> program_rows;
+	std::vector<uint8_t> program_primitive_flags;
+	std::vector<Interval> program_intervals;
+	std::vector<uint32_t> program_registers;
+	std::vector<uint32_t> program_expanded;
+
+	// Specialized programs for every level of tiles in rasterize.
+	std::vector<Program> tile_programs;
+
+	// Signs of operation results found so far for the current point in is_inside,
+	// valid if their generation matches the current one.
+	std::vector<uint8_t> operation_signs;
+	std::vector<uint32_t> operation_generations;
+	std::vector<uint32_t> operation_costs;
+	std::vector<uint32_t> inside_pending;
+
+	// operation_costs are kept for the last object passed to is_inside, so
+	// picking many points of one object does not walk all of its operations
+	// every time. The object is told by its address, where its arrays are
+	// stored, their sizes and whether scale is uniform. Costs only order the
+	// tests, an object changed in place without any of these changing gives
+	// right answers, just maybe slower.
+	Object const *costs_object = nullptr;
+	Primitive const *costs_primitives = nullptr;
+	Operation const *costs_operations = nullptr;
+	std::size_t costs_primitive_count = 0;
+	std::size_t costs_operation_count = 0;
+	bool costs_uniform_scale = false;
+
+	// Primitives are evaluated once per point even if multiple operations use them.
+	// A cached result is valid if its generation matches the current one.
+	std::vector<float> primitive_results;
+	std::vector<uint32_t> primitive_generations;
+	uint32_t generation = 0;
+
+	// Object read from a SceneView by functions that take one. It is only read
+	// again when another object is passed, so calls for many points of the same
+	// object don't pay for reading it. SceneView::id and where the object is
+	// stored tell which one was read.
+	Object view_object;
+	uint64_t view_object_id = 0;
+	uint8_t const *view_object_data = nullptr;
+};
+
+// Functions below take an optional EvalPrecision used for ellipses.
+
 // Evaluates distance to primitive at point.
-SDFD_DEF float evaluate(Scene const &scene, Primitive const &primitive, Vector2 point);
+SDFD_DEF float evaluate(Scene const &scene, Primitive const &primitive, Vector2 point, EvalPrecision precision = EvalPrecision::exact);
 
 // Evaluates distance to primitives at point.
 // If object contains no operations, returns distance to last object, otherwise
 // if object contains no primitives, returns infinity.
-SDFD_DEF float evaluate(Scene const &scene, Object const &object, Vector2 point);
+SDFD_DEF float evaluate(Scene const &scene, Object const &object, Vector2 point, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF float evaluate(EvalContext &context, Scene const &scene, Object const &object, Vector2 point, EvalPrecision precision = EvalPrecision::exact);
+
+// Evaluates distance to primitive at points {xs[i], ys[i]} and writes it to out[i].
+// xs and ys must be the same size, out must be at least that size.
+SDFD_DEF void evaluate_batch(Scene const &scene, Primitive const &primitive, std::span<float const> xs, std::span<float const> ys, std::span<float> out, EvalPrecision precision = EvalPrecision::exact);
+
+// Evaluates distance to object at every point and writes it to out[i].
+// Same as calling evaluate for each point, but operations are dispatched once per
+// batch of points instead of once per point.
+// out must be at least as big as points.
+SDFD_DEF void evaluate_batch(Scene const &scene, Object const &object, std::span<Vector2 const> points, std::span<float> out, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF void evaluate_batch(EvalContext &context, Scene const &scene, Object const &object, std::span<Vector2 const> points, std::span<float> out, EvalPrecision precision = EvalPrecision::exact);
+
+// Same as above, but point coordinates are passed in separate arrays.
+SDFD_DEF void evaluate_batch(Scene const &scene, Object const &object, std::span<float const> xs, std::span<float const> ys, std::span<float> out, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF void evaluate_batch(EvalContext &context, Scene const &scene, Object const &object, std::span<float const> xs, std::span<float const> ys, std::span<float> out, EvalPrecision precision = EvalPrecision::exact);
+
+// Returns a range that contains distances to primitive at all points in rect.
+// With EvalPrecision::fast distances can be outside of it by their error.
+SDFD_DEF Interval evaluate_interval(Scene const &scene, Primitive const &primitive, Rect rect, EvalPrecision precision = EvalPrecision::exact);
+
+// Returns a range that contains distances to object at all points in rect.
+// It can be wider than the actual range, but never narrower. If the whole
+// range is above or below zero, every point in rect is outside or inside.
+SDFD_DEF Interval evaluate_interval(Scene const &scene, Object const &object, Rect rect, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF Interval evaluate_interval(EvalContext &context, Scene const &scene, Object const &object, Rect rect, EvalPrecision precision = EvalPrecision::exact);
+
+// Returns a rect that contains every point where distance to primitive or
+// object is not positive. Sides that are not bounded are infinite, and min is
+// greater than max when no point is inside. min unites bounds of its arguments,
+// max intersects them, neg is unbounded. Only planes along an axis bound
+// a side. Outside of it distance is at least the larger of distances to it
+// along x and y, except for ellipses with EvalPrecision::bound.
+// All sides are NaN when distance can be NaN, as with invalid references and
+// primitives that are not finite, because min and max pass NaN on or drop it
+// depending on its position.
+SDFD_DEF Rect get_bounds(Scene const &scene, Primitive const &primitive);
+SDFD_DEF Rect get_bounds(Scene const &scene, Object const &object);
+SDFD_DEF Rect get_bounds(EvalContext &context, Scene const &scene, Object const &object);
+
+// Returns whether evaluate(scene, object, point) < 0, usually with much less work.
+// min and max are treated as OR and AND of signs of their arguments. The cheaper
+// argument is tested first, planes before circles before operations, and the
+// other one is skipped if the first decides the result.
+// Can differ from evaluate where an argument of min or max is NaN.
+// Only signs matter here, so EvalPrecision::bound is the cheapest way to get
+// the same answer.
+SDFD_DEF bool is_inside(Scene const &scene, Object const &object, Vector2 point, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF bool is_inside(EvalContext &context, Scene const &scene, Object const &object, Vector2 point, EvalPrecision precision = EvalPrecision::exact);
+
+// Writes is_inside for every point to out.
+SDFD_DEF void is_inside_batch(Scene const &scene, Object const &object, std::span<Vector2 const> points, std::span<bool> out, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF void is_inside_batch(EvalContext &context, Scene const &scene, Object const &object, std::span<Vector2 const> points, std::span<bool> out, EvalPrecision precision = EvalPrecision::exact);
+
+// Maps pixels of an image to scene space with an affine transform.
+// Center of pixel (x, y) is at origin + (x + 0.5) * x_axis + (y + 0.5) * y_axis.
+struct Viewport {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	Vector2 origin = {0, 0};
+	Vector2 x_axis = {1, 0};
+	Vector2 y_axis = {0, 1};
+};
+
+// Layout of a pixel in RasterTarget. Formats with "coverage" store
+// clamp(0.5 - distance / pixel_size, 0, 1) scaled to 0..255, where pixel_size
+// is the square root of the area of a pixel in scene space.
+enum class PixelFormat : uint8_t {
+	// float, distance clamped to [-band, band].
+	distance_f32,
+
+	// int8_t, distance / band mapped from [-1, 1] to [-127, 127].
+	distance_snorm8,
+
+	// uint8_t, distance / band mapped from [-1, 1] to [0, 255], edge is at 128.
+	distance_unorm8,
+
+	// uint8_t, coverage.
+	alpha8,
+
+	// 4 x uint8_t, coverage in r, g and b, 255 in a.
+	rgba8,
+
+	// 4 x uint8_t, coverage of left, middle and right thirds of the pixel in r,
+	// g and b, or b, g and r with SubpixelOrder::bgr, 255 in a. Coverage goes
+	// from 0 to 1 over the width of a subpixel.
+	rgba8_lcd,
+};
+
+// Order of subpixels on the display from left to right.
+enum class SubpixelOrder : uint8_t {
+	rgb,
+	bgr,
+};
+
+// Caller owned image rasterize writes to.
+struct RasterTarget {
+	void *data = nullptr;
+
+	// Bytes between starts of consecutive rows. Can be negative.
+	std::ptrdiff_t stride = 0;
+
+	PixelFormat format = PixelFormat::distance_f32;
+
+	// Distance that maps to the ends of the range in distance formats.
+	// Not used by coverage formats.
+	float band = 1;
+
+	// Used by rgba8_lcd.
+	SubpixelOrder subpixel_order = SubpixelOrder::rgb;
+
+	// Used by rgba8_lcd. Applies FreeType's default 5 tap filter across
+	// subpixels to reduce color fringes. It spreads every edge over about a
+	// pixel, without it the edge is a subpixel wide.
+	bool lcd_filter = false;
+};
+
+// Evaluates object at the center of every pixel of viewport and writes the
+// result to target converted to its format. The image is split into tiles,
+// and tiles whose whole distance interval is outside the range the format can
+// represent are filled at once, so only pixels near the edges of the object
+// are evaluated. Conversion is done per tile, there is no intermediate image.
+// EvalPrecision::fast is accurate enough for coverage formats.
+SDFD_DEF void rasterize(Scene const &scene, Object const &object, Viewport const &viewport, RasterTarget const &target, EvalPrecision precision = EvalPrecision::exact);
+
+// Runs a job on a set of threads. Implement this to rasterize on your own threads.
+struct Executor {
+	// Function with data it is called with, which stays owned by the caller of run.
+	struct Job {
+		void (*function)(void *data, uint32_t thread_index) = nullptr;
+		void *data = nullptr;
+
+		void operator()(uint32_t thread_index) const { function(data, thread_index); }
+	};
+
+	virtual ~Executor() = default;
+
+	virtual uint32_t get_thread_count() = 0;
+
+	// Calls job(thread_index) once for every thread_index in [0, get_thread_count())
+	// concurrently and returns after all of them return.
+	virtual void run(Job job) = 0;
+};
+
+// Executor that owns get_thread_count() - 1 threads, the thread calling run is
+// used as thread 0. Only one run may be in progress at a time.
+struct ThreadPool : Executor {
+	// Zero thread_count uses one thread per hardware thread.
+	explicit ThreadPool(uint32_t thread_count = 0);
+	~ThreadPool();
+
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+
+	uint32_t get_thread_count() override;
+	void run(Job job) override;
+
+private:
+	// Threads and their synchronization, only defined with SDFD_IMPLEMENTATION
+	// so that the header doesn't need to include <thread> and <mutex>.
+	struct State;
+	std::unique_ptr<State> state;
+};
+
+// Same as rasterize above, but root tiles are spread over the threads of executor.
+// Every thread starts with a contiguous range of tiles and steals from other
+// threads when it runs out, because tiles on edges cost much more than the rest.
+// Threads use their own thread local EvalContext.
+SDFD_DEF void rasterize(Scene const &scene, Object const &object, Viewport const &viewport, RasterTarget const &target, Executor &executor, EvalPrecision precision = EvalPrecision::exact);
+
+// Merges equal primitives and operations that have the same kind and arguments,
+// so that each of them is evaluated once per point. min_range and max_range are
+// split into chains of min and max first.
+// Evaluating the object gives the same result after this.
+SDFD_DEF void deduplicate(Object &object);
+
+// Removes primitives and operations that don't affect the result, computes
+// operations on constants, removes double negations and min or max of the
+// same argument, then deduplicates and fuses.
+// Evaluating the object gives the same result after this.
+SDFD_DEF void optimize(Object &object);
+
+// Rewrites chains like min(min(min(a, b), c), d) into min_range and max(a, neg(b))
+// into max_neg. Primitives are renumbered in order of first use, so that
+// chains built one primitive at a time become ranges.
+// Evaluating the object gives the same result after this.
+SDFD_DEF void fuse(Object &object);
+
+// Lowers object into a program that evaluates ellipses with precision.
+// Returns empty optional if evaluating the object needs more than Program::max_register_count registers.
+SDFD_DEF std::optional<Program> compile(Scene const &scene, Object const &object, EvalPrecision precision = EvalPrecision::exact);
+
+// Evaluates distance to compiled object at point.
+// Gives the same result as evaluating the object it was compiled from.
+SDFD_DEF float evaluate(Program const &program, Vector2 point);
+
+// Evaluates distance to compiled object at every point, like evaluate_batch for objects.
+SDFD_DEF void evaluate_batch(Program const &program, std::span<Vector2 const> points, std::span<float> out);
+SDFD_DEF void evaluate_batch(EvalContext &context, Program const &program, std::span<Vector2 const> points, std::span<float> out);
+SDFD_DEF void evaluate_batch(Program const &program, std::span<float const> xs, std::span<float const> ys, std::span<float> out);
+SDFD_DEF void evaluate_batch(EvalContext &context, Program const &program, std::span<float const> xs, std::span<float const> ys, std::span<float> out);
+
+// Returns a range that contains distances to compiled object at all points in rect.
+SDFD_DEF Interval evaluate_interval(Program const &program, Rect rect);
+
+// Returns a program that gives the same distances as program at all points in rect,
+// but does less work. Every min or max whose interval shows that it always picks
+// the same argument in rect is replaced by that argument, and instructions that
+// stop affecting the result are removed.
+SDFD_DEF Program specialize(Program const &program, Rect rect);
+
+// Same as the functions taking Scene and Object, with scale of view. Object is
+// read into context.view_object first, or into the thread local context by
+// functions that don't take one, unless it is the object that was read last.
+SDFD_DEF float evaluate(EvalContext &context, SceneView const &view, ObjectView object, Vector2 point, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF void evaluate_batch(EvalContext &context, SceneView const &view, ObjectView object, std::span<Vector2 const> points, std::span<float> out, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF Interval evaluate_interval(EvalContext &context, SceneView const &view, ObjectView object, Rect rect, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF bool is_inside(EvalContext &context, SceneView const &view, ObjectView object, Vector2 point, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF Rect get_bounds(EvalContext &context, SceneView const &view, ObjectView object);
+SDFD_DEF std::optional<Program> compile(SceneView const &view, ObjectView object, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF void rasterize(SceneView const &view, ObjectView object, Viewport const &viewport, RasterTarget const &target, EvalPrecision precision = EvalPrecision::exact);
+SDFD_DEF void rasterize(SceneView const &view, ObjectView object, Viewport const &viewport, RasterTarget const &target, Executor &executor, EvalPrecision precision = EvalPrecision::exact);
+
+// Scene with its scale baked into every object. Objects are compiled on first
+// use, so primitives are scaled once instead of at every point, and with
+// uniform scale circles use distance(Circle) instead of the ellipse solver.
+// Changing scene.scale or the number of objects recompiles objects on their
+// next use. After editing objects in place call invalidate.
+// Compiling mutates PreparedScene, so it must not be shared between threads
+// without synchronization. Objects that can not be compiled are evaluated from
+// the scene.
+struct PreparedScene {
+	Scene const *scene = nullptr;
+
+	// Scale objects were compiled with.
+	Vector2 scale = {1, 1};
+
+	// Used for ellipses. Objects compiled with a different one are compiled
+	// again on their next use, so it can be changed at any time.
+	EvalPrecision precision = EvalPrecision::exact;
+
+	struct PreparedObject {
+		bool compiled = false;
+		std::optional<Program> program;
+
+		// Used by is_inside, empty until first needed.
+		std::vector<uint32_t> operation_costs;
+
+		// get_bounds of the object, empty until first needed.
+		std::optional<Rect> bounds;
+	};
+	std::vector<PreparedObject> objects;
+};
+
+SDFD_DEF PreparedScene prepare(Scene const &scene, EvalPrecision precision = EvalPrecision::exact);
+
+// Drops all compiled objects.
+SDFD_DEF void invalidate(PreparedScene &prepared);
+
+// Returns compiled object, compiling it if needed, or null if it can not be compiled.
+SDFD_DEF Program const *get_program(PreparedScene &prepared, uint32_t object_index);
+
+// Same as the functions taking scene.objects[object_index].
+SDFD_DEF float evaluate(PreparedScene &prepared, uint32_t object_index, Vector2 point);
+SDFD_DEF void evaluate_batch(PreparedScene &prepared, uint32_t object_index, std::span<Vector2 const> points, std::span<float> out);
+SDFD_DEF void evaluate_batch(PreparedScene &prepared, uint32_t object_index, std::span<float const> xs, std::span<float const> ys, std::span<float> out);
+SDFD_DEF Interval evaluate_interval(PreparedScene &prepared, uint32_t object_index, Rect rect);
+SDFD_DEF bool is_inside(PreparedScene &prepared, uint32_t object_index, Vector2 point);
+
+// Same as get_bounds of scene.objects[object_index], kept until PreparedScene
+// is invalidated. is_inside and rasterize skip points and tiles outside of them.
+SDFD_DEF Rect get_bounds(PreparedScene &prepared, uint32_t object_index);
+SDFD_DEF void rasterize(PreparedScene &prepared, uint32_t object_index, Viewport const &viewport, RasterTarget const &target);
+SDFD_DEF void rasterize(PreparedScene &prepared, uint32_t object_index, Viewport const &viewport, RasterTarget const &target, Executor &executor);
 
 }
 
 #ifdef SDFD_IMPLEMENTATION
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <string>
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if !defined(SDFD_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SDFD_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#else
+#define SDFD_SIMD_X86 0
+#endif
 
 namespace sdfd {
 
@@ -221,7 +885,8 @@ float distance(Ellipse e, Vector2 in_p) {
 	p = abs( p ); 
     if( p.x>p.y ){ p=p.yx(); ab=ab.yx(); }
 	
-	float l = ab.y*ab.y - ab.x*ab.x;
+	// Factored so that equal radii give exactly zero even when the compiler contracts into fma.
+	float l = (ab.y - ab.x)*(ab.y + ab.x);
 	
 	if (fabsf(l) < 1e-9f) {
 		return distance(Circle{e.center, ab.y}, in_p);
@@ -263,10 +928,43 @@ float distance(Ellipse e, Vector2 in_p) {
     co = (co-m)/2.0f;
 
     float si = sqrtf( std::max(1.0f-co*co,0.0f) );
+
+	// Solution above loses a lot of precision for big or long ellipses, one Newton
+	// step on the angle of the closest point fixes most of it. f is half the
+	// derivative of squared distance by the angle and df is its derivative,
+	// which is positive near the minimum. The step is skipped where it is not.
+	float f = l*si*co + ab.x*p.x*si - ab.y*p.y*co;
+	float df = l*(co*co - si*si) + ab.x*p.x*co + ab.y*p.y*si;
+	if (df > 0) {
+		float step = f/df;
+		Vector2 rotated = {co + si*step, si - co*step};
+		rotated = rotated / length(rotated);
+		co = rotated.x;
+		si = rotated.y;
+	}
  
 	Vector2 r = ab * Vector2{co,si};
 	
-    return length(r-p) * sign(p.y-r.y);
+	// Closest point is not precise enough to tell the side close to flatter
+	// parts of the ellipse, so the sign comes from the equation of the ellipse.
+	Vector2 u = (in_p - e.center) / e.radius;
+    return length(r-p) * sign(dot(u, u) - 1);
+}
+
+float distance_bound(Ellipse e, Vector2 p) {
+	// Gradient of length((p - center) / radius) is at most 1 / min(radius) long,
+	// so scaled by min(radius) it is 1-Lipschitz and zero on the ellipse.
+	return (length((p - e.center) / e.radius) - 1) * std::min(e.radius.x, e.radius.y);
+}
+
+float distance(Ellipse e, Vector2 p, EvalPrecision precision) {
+	switch (precision) {
+		case EvalPrecision::exact: return distance(e, p);
+		case EvalPrecision::fast:  return distance_fast(e, p);
+		case EvalPrecision::bound: return distance_bound(e, p);
+	}
+	assert(!"invalid EvalPrecision");
+	return distance(e, p);
 }
 
 Plane plane_from_point_and_normal(Vector2 point, Vector2 normal) {
@@ -286,6 +984,30 @@ uint32_t get_arity(Operation::Kind operation_kind) {
 	return 0;
 }
 
+static bool is_range(Operation::Kind kind) {
+	return kind == Operation::Kind::min_range || kind == Operation::Kind::max_range;
+}
+
+static bool is_valid_range(Operation const &operation) {
+	return operation.args[0].kind == operation.args[1].kind && operation.args[0].value <= operation.args[1].value;
+}
+
+// Calls fn with every argument operation reads, in order. Invalid ranges read nothing.
+template <class Fn>
+static void for_each_argument(Operation const &operation, Fn &&fn) {
+	if (is_range(operation.kind)) {
+		if (is_valid_range(operation)) {
+			for (uint32_t value = operation.args[0].value; value <= operation.args[1].value; ++value) {
+				fn(ArgumentIndex{.kind = operation.args[0].kind, .value = value});
+			}
+		}
+		return;
+	}
+	for (uint32_t i = 0; i < get_arity(operation.kind); ++i) {
+		fn(operation.args[i]);
+	}
+}
+
 static std::optional<std::string> read_entire_file(char const *path) {
 	std::optional<std::string> result;
 
@@ -315,42 +1037,186 @@ static std::optional<std::string> read_entire_file(char const *path) {
 	return result;
 }
 
-bool serialize(bool reading, Scene &scene, char const *path) {
-	FILE *file = 0;
-	std::string content = {};
-	char *cursor = {};
-	char *end = {};
+// Number of bytes stored after kind of primitive, zero if kind is not valid.
+static uint32_t get_stored_size(Primitive::Kind kind) {
+	switch (kind) {
+		#define x(type, name, value) case Primitive::Kind::name: return sizeof(type);
+		SDFD_ENUMERATE_PRIMITIVE(x)
+		#undef x
+	}
+	return 0;
+}
+
+static bool is_valid(Operation::Kind kind) {
+	switch (kind) {
+		#define x(name, value, arity) case Operation::Kind::name: return true;
+		SDFD_ENUMERATE_OPERATION(x)
+		#undef x
+	}
+	return false;
+}
 
-	if (reading) {
-		auto maybe_content = read_entire_file(path);
-		if (!maybe_content)
-			return {};
-		content = std::move(maybe_content).value();
-		cursor = content.data();
-		end = content.data() + content.size();
-	} else {
-		file = fopen(path, "wb");
-		if (!file) {
+// Number of bytes object takes in files.
+static uint64_t get_stored_size(Object const &object) {
+	uint64_t size = 2 * sizeof(uint32_t);
+	for (auto &primitive : object.primitives) {
+		size += sizeof(primitive.kind) + get_stored_size(primitive.kind);
+	}
+	for (auto &operation : object.operations) {
+		size += sizeof(operation.kind) + get_arity(operation.kind) * sizeof(operation.args[0]);
+	}
+	return size;
+}
+
+// File that store_to_file writes before renaming it to the path it was given.
+struct TemporaryFile {
+	std::string path;
+#ifdef _WIN32
+	HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+	int fd = -1;
+#endif
+};
+
+static std::atomic<uint32_t> temporary_file_counter;
+
+// Creates a new file next to path. Its name has the process id and a counter in
+// it, so concurrent writers of the same path don't share one, and a file that
+// already exists is never opened.
+static bool create_temporary_file(char const *path, TemporaryFile &file) {
+	for (uint32_t attempt = 0; attempt < 100; ++attempt) {
+		uint32_t counter = temporary_file_counter.fetch_add(1, std::memory_order_relaxed);
+#ifdef _WIN32
+		file.path = std::string(path) + "." + std::to_string(GetCurrentProcessId()) + "." + std::to_string(counter) + ".tmp";
+		file.handle = CreateFileA(file.path.c_str(), GENERIC_WRITE, 0, 0, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0);
+		if (file.handle != INVALID_HANDLE_VALUE)
+			return true;
+		if (GetLastError() != ERROR_FILE_EXISTS)
 			return false;
-		}
+#else
+		file.path = std::string(path) + "." + std::to_string(getpid()) + "." + std::to_string(counter) + ".tmp";
+		file.fd = open(file.path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+		if (file.fd != -1)
+			return true;
+		if (errno != EEXIST)
+			return false;
+#endif
 	}
-	
-	defer (
-		if (!reading) {
-			fclose(file);
+	return false;
+}
+
+static bool write_temporary_file(TemporaryFile &file, void const *data, std::size_t size) {
+	uint8_t const *cursor = (uint8_t const *)data;
+	while (size) {
+#ifdef _WIN32
+		DWORD written;
+		if (!WriteFile(file.handle, cursor, (DWORD)std::min<std::size_t>(size, 1 << 30), &written, 0))
+			return false;
+#else
+		ssize_t written = write(file.fd, cursor, size);
+		if (written == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
 		}
-	);
+#endif
+		cursor += written;
+		size -= written;
+	}
+	return true;
+}
+
+// Contents are flushed to disk first, otherwise after a crash the file can be
+// renamed while they are not written yet.
+static bool close_temporary_file(TemporaryFile &file) {
+#ifdef _WIN32
+	bool closed = FlushFileBuffers(file.handle);
+	closed = CloseHandle(file.handle) && closed;
+#else
+	bool closed = fsync(file.fd) == 0;
+	closed = close(file.fd) == 0 && closed;
+#endif
+	return closed;
+}
+
+// Where serialize reads from or writes to.
+struct Serializer {
+	bool reading = false;
+
+	// Used when reading.
+	uint8_t const *cursor = nullptr;
+	uint8_t const *end = nullptr;
+
+	// Used when writing. First size bytes of buffer are written, the rest is
+	// space reserved for the next ones. If file is not null they are written
+	// to it whenever there are more than serializer_flush_size of them.
+	std::vector<uint8_t> *buffer = nullptr;
+	std::size_t size = 0;
+	TemporaryFile *file = nullptr;
+};
+
+static constexpr std::size_t serializer_flush_size = 1 << 20;
+
+static constexpr std::size_t max_stored_primitive_size = std::max({
+	#define x(type, name, value) sizeof(Primitive::Kind) + sizeof(type),
+	SDFD_ENUMERATE_PRIMITIVE(x)
+	#undef x
+});
+
+static constexpr std::size_t max_stored_operation_size = sizeof(Operation::Kind) + sizeof(Operation::args);
+
+// Smallest number of bytes an item takes in files. Counts read from untrusted
+// data are checked against them before anything is allocated for the items.
+static constexpr std::size_t min_stored_primitive_size = std::min({
+	#define x(type, name, value) sizeof(Primitive::Kind) + sizeof(type),
+	SDFD_ENUMERATE_PRIMITIVE(x)
+	#undef x
+});
+
+static constexpr std::size_t min_stored_operation_size = std::min({
+	#define x(name, value, arity) sizeof(Operation::Kind) + arity * sizeof(ArgumentIndex),
+	SDFD_ENUMERATE_OPERATION(x)
+	#undef x
+});
+
+// Primitive and operation counts.
+static constexpr std::size_t min_stored_object_size = 2 * sizeof(uint32_t);
+
+static bool flush(Serializer &serializer) {
+	if (!write_temporary_file(*serializer.file, serializer.buffer->data(), serializer.size))
+		return false;
+	serializer.size = 0;
+	return true;
+}
+
+// Makes room for at least size bytes, so that they are copied without checks.
+static bool reserve(Serializer &serializer, std::size_t size) {
+	if (serializer.reading)
+		return true;
+	if (serializer.file && serializer.size >= serializer_flush_size && !flush(serializer))
+		return false;
+	auto &buffer = *serializer.buffer;
+	if (buffer.size() - serializer.size < size)
+		buffer.resize(std::max(serializer.size + size, buffer.size() * 2));
+	return true;
+}
+
+bool serialize(Serializer &serializer, Scene &scene) {
+	bool reading = serializer.reading;
 
 	auto serialize_buffer = [&](void *data, uint32_t size) -> bool {
 		if (reading) {
-			if (cursor + size > end) {
+			if ((std::size_t)(serializer.end - serializer.cursor) < size) {
 				return false;
 			}
-			memcpy(data, cursor, size);
-			cursor += size;
+			memcpy(data, serializer.cursor, size);
+			serializer.cursor += size;
 			return true;
 		} else {
-			return fwrite(data, size, 1, file);
+			assert(serializer.buffer->size() - serializer.size >= size);
+			memcpy(serializer.buffer->data() + serializer.size, data, size);
+			serializer.size += size;
+			return true;
 		}
 	};
 
@@ -358,6 +1224,12 @@ bool serialize(bool reading, Scene &scene, char const *path) {
 		return serialize_buffer(&value, sizeof(value));
 	};
 
+	// Bytes left to read, checked against counts before resizing for them.
+	auto get_remaining = [&]() -> std::size_t {
+		return reading ? (std::size_t)(serializer.end - serializer.cursor) : SIZE_MAX;
+	};
+
+	// Unknown kinds are rejected, as parse_scene does.
 	auto serialize_primitive = [&](Primitive &primitive) {
 		if (!serialize_value(primitive.kind))
 			return false;
@@ -366,32 +1238,36 @@ bool serialize(bool reading, Scene &scene, char const *path) {
 				case Primitive::Kind::name: {             \
 					if (!serialize_value(primitive.name)) \
 						return false;                     \
-					break;                                \
+					return true;                          \
 				}
 			SDFD_ENUMERATE_PRIMITIVE(x)
 			#undef x
 		}
-		return true;
+		return false;
 	};
 
 	auto serialize_operation = [&](Operation &operation) {
-		if (!serialize_value(operation.kind))
+		if (!serialize_value(operation.kind) || !is_valid(operation.kind))
 			return false;
 		if (!serialize_buffer(operation.args, sizeof(operation.args[0]) * get_arity(operation.kind)))
 			return false;
 		return true;
 	};
 
-	#define SERIALIZE_VECTOR(object, vector) \
-		{                                    \
-			uint32_t size = vector.size();   \
-			if (!serialize_value(size))      \
-				return false;                \
-			vector.resize(size);             \
-		}                                    \
+	#define SERIALIZE_VECTOR(object, vector, min_stored_size)     \
+		{                                                         \
+			uint32_t size = vector.size();                        \
+			if (!serialize_value(size))                           \
+				return false;                                     \
+			if (size > get_remaining() / (min_stored_size))       \
+				return false;                                     \
+			vector.resize(size);                                  \
+		}                                                         \
 		for (auto &object : vector)
 
 	std::string header_id = "sdfd";
+	if (!reserve(serializer, header_id.size() + sizeof(uint16_t) + sizeof(uint32_t)))
+		return false;
 	if (!serialize_buffer(header_id.data(), header_id.size()))
 		return false;
 	if (header_id != "sdfd")
@@ -403,18 +1279,44 @@ bool serialize(bool reading, Scene &scene, char const *path) {
 	if (version > SDFD_VERSION)
 		return false;
 
-	SERIALIZE_VECTOR(object, scene.objects) {
-		SERIALIZE_VECTOR(primitive, object.primitives) {
+	uint32_t object_count = scene.objects.size();
+	if (!serialize_value(object_count))
+		return false;
+	if (object_count > get_remaining() / min_stored_object_size)
+		return false;
+
+	if (version >= 2) {
+		// Offsets of objects and of scene.primitives after them. Reading skips
+		// them, they are only used by load_object and SceneView.
+		uint64_t offset = header_id.size() + sizeof(version) + sizeof(object_count) + ((uint64_t)object_count + 1) * sizeof(offset);
+		if (!reserve(serializer, ((std::size_t)object_count + 1) * sizeof(offset)))
+			return false;
+		for (uint64_t i = 0; i <= object_count; ++i) {
+			if (!serialize_value(offset))
+				return false;
+			if (!reading && i < object_count)
+				offset += get_stored_size(scene.objects[i]);
+		}
+	}
+
+	scene.objects.resize(object_count);
+	for (auto &object : scene.objects) {
+		std::size_t size = 2 * sizeof(uint32_t) + object.primitives.size() * max_stored_primitive_size + object.operations.size() * max_stored_operation_size;
+		if (!reserve(serializer, size))
+			return false;
+		SERIALIZE_VECTOR(primitive, object.primitives, min_stored_primitive_size) {
 			if (!serialize_primitive(primitive))
 				return false;
 		}
-		SERIALIZE_VECTOR(operation, object.operations) {
+		SERIALIZE_VECTOR(operation, object.operations, min_stored_operation_size) {
 			if (!serialize_operation(operation))
 				return false;
 		}
 	}
 	
-	SERIALIZE_VECTOR(primitive, scene.primitives) {
+	if (!reserve(serializer, sizeof(uint32_t) + scene.primitives.size() * max_stored_primitive_size))
+		return false;
+	SERIALIZE_VECTOR(primitive, scene.primitives, min_stored_primitive_size) {
 		if (!serialize_primitive(primitive))
 			return false;
 	}
@@ -425,67 +1327,670 @@ bool serialize(bool reading, Scene &scene, char const *path) {
 }
 
 bool store_to_file(Scene const &scene, char const *path) {
-	return serialize(false, const_cast<Scene&>(scene), path); // I promise
-}
-std::optional<Scene> load_from_file(char const *path) {
-	std::optional<Scene> result;
-	result.emplace();
-	if (!serialize(true, result.value(), path)) {
-		result.reset();
+	TemporaryFile file;
+	if (!create_temporary_file(path, file)) {
+		return false;
+	}
+
+	// Reused by every store_to_file on this thread.
+	thread_local std::vector<uint8_t> buffer;
+
+	Serializer serializer = {.reading = false, .buffer = &buffer, .file = &file};
+	bool stored = serialize(serializer, const_cast<Scene&>(scene)) && flush(serializer); // I promise
+	stored = close_temporary_file(file) && stored;
+
+	if (stored) {
+#ifdef _WIN32
+		stored = MoveFileExA(file.path.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+		stored = rename(file.path.c_str(), path) == 0;
+#endif
+	}
+	if (!stored) {
+		remove(file.path.c_str());
+	}
+	return stored;
+}
+
+std::optional<Scene> load_from_file(char const *path) {
+	auto content = read_entire_file(path);
+	if (!content)
+		return {};
+	return load_from_memory({(uint8_t const *)content->data(), content->size()});
+}
+
+bool store_to_memory(Scene const &scene, std::vector<uint8_t> &buffer) {
+	// Bytes already in buffer are overwritten instead of cleared.
+	Serializer serializer = {.reading = false, .buffer = &buffer};
+	bool stored = serialize(serializer, const_cast<Scene&>(scene)); // I promise
+	buffer.resize(serializer.size);
+	return stored;
+}
+
+std::optional<Scene> load_from_memory(std::span<uint8_t const> data) {
+	std::optional<Scene> result;
+
+	Serializer serializer = {
+		.reading = true,
+		.cursor = data.data(),
+		.end = data.data() + data.size(),
+	};
+
+	result.emplace();
+	if (!serialize(serializer, result.value())) {
+		result.reset();
+	}
+	return result;
+}
+
+SceneView::Mapping::Mapping(Mapping &&that) {
+	*this = std::move(that);
+}
+
+SceneView::Mapping &SceneView::Mapping::operator=(Mapping &&that) {
+	std::swap(data, that.data);
+	std::swap(size, that.size);
+	return *this;
+}
+
+SceneView::Mapping::~Mapping() {
+	if (!data)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void *)data, size);
+#endif
+}
+
+// Reads value stored at cursor without alignment, returns false if it goes past end.
+template <class T>
+static bool read_value(uint8_t const *&cursor, uint8_t const *end, T &value) {
+	if ((std::size_t)(end - cursor) < sizeof(value))
+		return false;
+	memcpy(&value, cursor, sizeof(value));
+	cursor += sizeof(value);
+	return true;
+}
+
+static bool skip_primitives(uint8_t const *&cursor, uint8_t const *end, uint32_t count) {
+	for (uint32_t i = 0; i < count; ++i) {
+		Primitive::Kind kind;
+		if (!read_value(cursor, end, kind))
+			return false;
+		uint32_t size = get_stored_size(kind);
+		if (size == 0 || (std::size_t)(end - cursor) < size)
+			return false;
+		cursor += size;
+	}
+	return true;
+}
+
+static bool skip_operations(uint8_t const *&cursor, uint8_t const *end, uint32_t count) {
+	for (uint32_t i = 0; i < count; ++i) {
+		Operation::Kind kind;
+		if (!read_value(cursor, end, kind) || !is_valid(kind))
+			return false;
+		uint32_t size = get_arity(kind) * sizeof(ArgumentIndex);
+		if ((std::size_t)(end - cursor) < size)
+			return false;
+		cursor += size;
+	}
+	return true;
+}
+
+// Finds where parts of object stored at cursor are and moves cursor past it.
+static bool parse_object(uint8_t const *&cursor, uint8_t const *end, ObjectView &object) {
+	if (!read_value(cursor, end, object.primitive_count))
+		return false;
+	object.primitives = cursor;
+	if (!skip_primitives(cursor, end, object.primitive_count))
+		return false;
+
+	if (!read_value(cursor, end, object.operation_count))
+		return false;
+	object.operations = cursor;
+	if (!skip_operations(cursor, end, object.operation_count))
+		return false;
+
+	object.end = cursor;
+	return true;
+}
+
+static uint64_t get_offset(SceneView const &view, uint32_t index) {
+	uint64_t offset;
+	memcpy(&offset, view.offsets + (std::size_t)index * sizeof(offset), sizeof(offset));
+	return offset;
+}
+
+// Same checks as serialize, and also that every kind is valid, so that objects
+// can be read without them later.
+static bool parse_scene(SceneView &view) {
+	uint8_t const *cursor = view.mapping.data;
+	uint8_t const *end = cursor + view.mapping.size;
+
+	char header_id[4];
+	if (!read_value(cursor, end, header_id) || memcmp(header_id, "sdfd", sizeof(header_id)) != 0)
+		return false;
+
+	uint16_t version;
+	if (!read_value(cursor, end, version) || version > SDFD_VERSION)
+		return false;
+
+	if (!read_value(cursor, end, view.object_count))
+		return false;
+
+	if (version >= 2) {
+		std::size_t size = ((std::size_t)view.object_count + 1) * sizeof(uint64_t);
+		if ((std::size_t)(end - cursor) < size)
+			return false;
+		view.offsets = cursor;
+		cursor += size;
+	}
+
+	view.objects_begin = cursor;
+	for (uint32_t i = 0; i <= view.object_count; ++i) {
+		if (view.offsets && get_offset(view, i) != (uint64_t)(cursor - view.mapping.data))
+			return false;
+		ObjectView object;
+		if (i < view.object_count && !parse_object(cursor, end, object))
+			return false;
+	}
+	view.objects_end = cursor;
+
+	if (!read_value(cursor, end, view.primitive_count))
+		return false;
+	view.primitives = cursor;
+	return skip_primitives(cursor, end, view.primitive_count);
+}
+
+std::optional<SceneView> map_scene(char const *path) {
+	std::optional<SceneView> result;
+	SceneView view;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return result;
+	defer(CloseHandle(file));
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || (unsigned long long)size.QuadPart > SIZE_MAX)
+		return result;
+
+	HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (!mapping)
+		return result;
+	defer(CloseHandle(mapping));
+
+	void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+		return result;
+	view.mapping.size = (std::size_t)size.QuadPart;
+#else
+	int file = open(path, O_RDONLY);
+	if (file == -1)
+		return result;
+	defer(close(file));
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size == 0)
+		return result;
+
+	void *data = mmap(0, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	if (data == MAP_FAILED)
+		return result;
+	view.mapping.size = status.st_size;
+#endif
+
+	view.mapping.data = (uint8_t const *)data;
+	if (!parse_scene(view))
+		return result;
+
+	static std::atomic<uint64_t> next_id = 1;
+	view.id = next_id.fetch_add(1, std::memory_order_relaxed);
+
+	result.emplace(std::move(view));
+	return result;
+}
+
+bool next_object(SceneView const &view, ObjectView &object) {
+	uint8_t const *cursor = object.end ? object.end : view.objects_begin;
+	if (cursor == view.objects_end)
+		return false;
+	return parse_object(cursor, view.objects_end, object);
+}
+
+bool get_object(SceneView const &view, uint32_t index, ObjectView &object) {
+	if (index >= view.object_count)
+		return false;
+
+	if (view.offsets) {
+		uint8_t const *cursor = view.mapping.data + get_offset(view, index);
+		return parse_object(cursor, view.objects_end, object);
+	}
+
+	object = {};
+	for (uint32_t i = 0; i <= index; ++i) {
+		next_object(view, object);
+	}
+	return true;
+}
+
+// Reads count primitives that were checked by parse_scene.
+static void read_primitives(uint8_t const *cursor, std::vector<Primitive> &primitives, uint32_t count) {
+	primitives.resize(count);
+	for (auto &primitive : primitives) {
+		memcpy(&primitive.kind, cursor, sizeof(primitive.kind));
+		cursor += sizeof(primitive.kind);
+		switch (primitive.kind) {
+			#define x(type, name, value)                                  \
+				case Primitive::Kind::name: {                             \
+					memcpy(&primitive.name, cursor, sizeof(primitive.name)); \
+					cursor += sizeof(primitive.name);                     \
+					break;                                                \
+				}
+			SDFD_ENUMERATE_PRIMITIVE(x)
+			#undef x
+		}
+	}
+}
+
+void read_object(ObjectView view, Object &object) {
+	read_primitives(view.primitives, object.primitives, view.primitive_count);
+
+	uint8_t const *cursor = view.operations;
+	object.operations.resize(view.operation_count);
+	for (auto &operation : object.operations) {
+		operation = {};
+		memcpy(&operation.kind, cursor, sizeof(operation.kind));
+		cursor += sizeof(operation.kind);
+		uint32_t size = get_arity(operation.kind) * sizeof(operation.args[0]);
+		memcpy(operation.args, cursor, size);
+		cursor += size;
+	}
+}
+
+void read_primitives(SceneView const &view, std::vector<Primitive> &primitives) {
+	read_primitives(view.primitives, primitives, view.primitive_count);
+}
+
+// Largest field is a primitive with its kind.
+static constexpr std::size_t reader_min_buffer_size = 64;
+
+SceneReader make_scene_reader(FILE *file, std::size_t buffer_size) {
+	SceneReader reader;
+	reader.read = [](void *source, void *data, std::size_t size) -> std::ptrdiff_t {
+		FILE *file = (FILE *)source;
+		std::size_t count = fread(data, 1, size, file);
+		if (count == 0 && ferror(file))
+			return SceneReader::read_failed;
+		return count;
+	};
+	reader.source = file;
+	reader.buffer.resize(std::max(buffer_size, reader_min_buffer_size));
+	return reader;
+}
+
+SceneReader make_scene_reader(int fd, std::size_t buffer_size) {
+	SceneReader reader;
+	reader.read = [](void *source, void *data, std::size_t size) -> std::ptrdiff_t {
+		int fd = (int)(intptr_t)source;
+#ifdef _WIN32
+		int count = _read(fd, data, (unsigned)std::min<std::size_t>(size, std::numeric_limits<int>::max()));
+		return count < 0 ? SceneReader::read_failed : count;
+#else
+		while (true) {
+			ssize_t count = read(fd, data, size);
+			if (count >= 0)
+				return count;
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return SceneReader::read_pending;
+			return SceneReader::read_failed;
+		}
+#endif
+	};
+	reader.source = (void *)(intptr_t)fd;
+	reader.buffer.resize(std::max(buffer_size, reader_min_buffer_size));
+	return reader;
+}
+
+// Makes at least size unparsed bytes available. Returns empty optional if they
+// are, otherwise what next_object has to return.
+static std::optional<ReadStatus> fill(SceneReader &reader, std::size_t size) {
+	while (reader.buffer_end - reader.buffer_begin < size) {
+		if (reader.buffer_end == reader.buffer.size()) {
+			memmove(reader.buffer.data(), reader.buffer.data() + reader.buffer_begin, reader.buffer_end - reader.buffer_begin);
+			reader.buffer_end -= reader.buffer_begin;
+			reader.buffer_begin = 0;
+		}
+
+		std::ptrdiff_t count = reader.read(reader.source, reader.buffer.data() + reader.buffer_end, reader.buffer.size() - reader.buffer_end);
+		if (count == SceneReader::read_pending)
+			return ReadStatus::pending;
+		if (count <= 0) {
+			// Input ended in the middle of the scene.
+			reader.stage = SceneReader::Stage::failed;
+			return ReadStatus::failed;
+		}
+		reader.buffer_end += count;
+	}
+	return {};
+}
+
+template <class T>
+static void take_value(SceneReader &reader, T &value) {
+	memcpy(&value, reader.buffer.data() + reader.buffer_begin, sizeof(value));
+	reader.buffer_begin += sizeof(value);
+}
+
+// Reads reader.items_left primitives into primitives, stopping early if input runs out.
+static std::optional<ReadStatus> take_primitives(SceneReader &reader, std::vector<Primitive> &primitives) {
+	for (; reader.items_left; --reader.items_left) {
+		Primitive primitive = {};
+		if (auto status = fill(reader, sizeof(primitive.kind)))
+			return status;
+		memcpy(&primitive.kind, reader.buffer.data() + reader.buffer_begin, sizeof(primitive.kind));
+
+		uint32_t size = get_stored_size(primitive.kind);
+		if (size == 0) {
+			reader.stage = SceneReader::Stage::failed;
+			return ReadStatus::failed;
+		}
+		if (auto status = fill(reader, sizeof(primitive.kind) + size))
+			return status;
+
+		take_value(reader, primitive.kind);
+		switch (primitive.kind) {
+			#define x(type, name, value) case Primitive::Kind::name: take_value(reader, primitive.name); break;
+			SDFD_ENUMERATE_PRIMITIVE(x)
+			#undef x
+		}
+		primitives.push_back(primitive);
+	}
+	return {};
+}
+
+static std::optional<ReadStatus> take_operations(SceneReader &reader, std::vector<Operation> &operations) {
+	for (; reader.items_left; --reader.items_left) {
+		Operation operation = {};
+		if (auto status = fill(reader, sizeof(operation.kind)))
+			return status;
+		memcpy(&operation.kind, reader.buffer.data() + reader.buffer_begin, sizeof(operation.kind));
+
+		if (!is_valid(operation.kind)) {
+			reader.stage = SceneReader::Stage::failed;
+			return ReadStatus::failed;
+		}
+		uint32_t size = get_arity(operation.kind) * sizeof(operation.args[0]);
+		if (auto status = fill(reader, sizeof(operation.kind) + size))
+			return status;
+
+		take_value(reader, operation.kind);
+		memcpy(operation.args, reader.buffer.data() + reader.buffer_begin, size);
+		reader.buffer_begin += size;
+		operations.push_back(operation);
+	}
+	return {};
+}
+
+ReadStatus next_object(SceneReader &reader) {
+	using Stage = SceneReader::Stage;
+
+	while (true) {
+		switch (reader.stage) {
+			case Stage::header: {
+				char header_id[4];
+				uint16_t version;
+				if (auto status = fill(reader, sizeof(header_id) + sizeof(version)))
+					return *status;
+				take_value(reader, header_id);
+				take_value(reader, reader.version);
+				if (memcmp(header_id, "sdfd", sizeof(header_id)) != 0 || reader.version > SDFD_VERSION) {
+					reader.stage = Stage::failed;
+					break;
+				}
+				reader.stage = Stage::object_count;
+				break;
+			}
+			case Stage::object_count: {
+				// There is one more offset than objects, the first one is skipped here.
+				uint64_t offset;
+				bool has_offsets = reader.version >= 2;
+				if (auto status = fill(reader, sizeof(reader.objects_left) + (has_offsets ? sizeof(offset) : 0)))
+					return *status;
+				take_value(reader, reader.objects_left);
+				if (has_offsets)
+					take_value(reader, offset);
+				reader.items_left = reader.objects_left;
+				reader.stage = has_offsets ? Stage::offsets : Stage::primitive_count;
+				break;
+			}
+			case Stage::offsets: {
+				for (; reader.items_left; --reader.items_left) {
+					uint64_t offset;
+					if (auto status = fill(reader, sizeof(offset)))
+						return *status;
+					take_value(reader, offset);
+				}
+				reader.stage = Stage::primitive_count;
+				break;
+			}
+			case Stage::primitive_count: {
+				if (!reader.objects_left) {
+					reader.stage = Stage::scene_primitive_count;
+					break;
+				}
+				if (auto status = fill(reader, sizeof(reader.items_left)))
+					return *status;
+				take_value(reader, reader.items_left);
+				reader.object.primitives.clear();
+				reader.object.operations.clear();
+				reader.stage = Stage::primitives;
+				break;
+			}
+			case Stage::primitives: {
+				if (auto status = take_primitives(reader, reader.object.primitives))
+					return *status;
+				reader.stage = Stage::operation_count;
+				break;
+			}
+			case Stage::operation_count: {
+				if (auto status = fill(reader, sizeof(reader.items_left)))
+					return *status;
+				take_value(reader, reader.items_left);
+				reader.stage = Stage::operations;
+				break;
+			}
+			case Stage::operations: {
+				if (auto status = take_operations(reader, reader.object.operations))
+					return *status;
+				--reader.objects_left;
+				reader.stage = Stage::primitive_count;
+				return ReadStatus::object;
+			}
+			case Stage::scene_primitive_count: {
+				if (auto status = fill(reader, sizeof(reader.items_left)))
+					return *status;
+				take_value(reader, reader.items_left);
+				reader.primitives.clear();
+				reader.stage = Stage::scene_primitives;
+				break;
+			}
+			case Stage::scene_primitives: {
+				if (auto status = take_primitives(reader, reader.primitives))
+					return *status;
+				reader.stage = Stage::end;
+				break;
+			}
+			case Stage::end:
+				return ReadStatus::end;
+			case Stage::failed:
+				return ReadStatus::failed;
+		}
+	}
+}
+
+// fseek takes long, which has 32 bits on Windows.
+static bool seek(FILE *file, uint64_t offset) {
+#ifdef _WIN32
+	return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+std::optional<Object> load_object(char const *path, uint32_t index) {
+	std::optional<Object> result;
+
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return result;
+	defer(fclose(file));
+
+	char header_id[4];
+	uint16_t version;
+	uint32_t object_count;
+	uint8_t header[sizeof(header_id) + sizeof(version) + sizeof(object_count)];
+	if (!fread(header, sizeof(header), 1, file))
+		return result;
+
+	uint8_t const *cursor = header;
+	read_value(cursor, std::end(header), header_id);
+	read_value(cursor, std::end(header), version);
+	read_value(cursor, std::end(header), object_count);
+	if (memcmp(header_id, "sdfd", sizeof(header_id)) != 0 || version > SDFD_VERSION || index >= object_count)
+		return result;
+
+	uint32_t first = 0;
+	if (version >= 2) {
+		uint64_t offset;
+		if (!seek(file, sizeof(header) + (uint64_t)index * sizeof(offset)) || !fread(&offset, sizeof(offset), 1, file) || !seek(file, offset))
+			return result;
+		first = index;
 	}
+
+	// Continue parsing at the first object that has to be read. Objects are
+	// usually small, so the buffer is too.
+	SceneReader reader = make_scene_reader(file, 1 << 12);
+	reader.version = version;
+	reader.stage = SceneReader::Stage::primitive_count;
+	reader.objects_left = object_count - first;
+	for (uint32_t i = first; i <= index; ++i) {
+		if (next_object(reader) != ReadStatus::object)
+			return result;
+	}
+
+	result.emplace(std::move(reader.object));
 	return result;
 }
 
-float evaluate(Scene const &scene, Primitive const &primitive, Vector2 point) {
+// Returns the plane going through the points of original plane multiplied by scale.
+// Normal is normalized, so distances to it are in scaled units like distances to
+// scaled circles. This is done for unit scale too, so that the plane does not
+// move when scale changes slightly and normal is not unit length.
+static Plane scale_plane(Plane plane, Vector2 scale) {
+	Vector2 a = plane.normal * plane.offset;
+	Vector2 b = a + perp(plane.normal);
+
+	a *= scale;
+	b *= scale;
+
+	Vector2 normal = perp(a - b);
+	normal = normal / length(normal);
+	return {
+		.normal = normal,
+		.offset = dot(a, normal),
+	};
+}
+
+float evaluate(Scene const &scene, Primitive const &primitive, Vector2 point, EvalPrecision precision) {
 	switch (primitive.kind) {
 		case Primitive::Kind::float1: {
 			return primitive.float1;
 		}
 		case Primitive::Kind::plane: {
-			Vector2 a = primitive.plane.normal * primitive.plane.offset;
-			Vector2 b = a + perp(primitive.plane.normal);
-
-			a *= scene.scale;
-			b *= scene.scale;
-
-			Vector2 normal = perp(a - b);
-			float offset = dot(a, normal);
-
-			return dot(normal, point) - offset;
+			Plane plane = scale_plane(primitive.plane, scene.scale);
+			return dot(plane.normal, point) - plane.offset;
 		}
 		case Primitive::Kind::circle: {
-			return distance(Ellipse{.center = scene.scale * primitive.circle.center, .radius = scene.scale * primitive.circle.radius}, point);
+			Ellipse ellipse = {.center = scene.scale * primitive.circle.center, .radius = scene.scale * primitive.circle.radius};
+			if (ellipse.radius.x == ellipse.radius.y) {
+				// distance(Ellipse) does the same in this case.
+				return distance(Circle{ellipse.center, ellipse.radius.x}, point);
+			}
+			return distance(ellipse, point, precision);
 		}
 		default:
 			assert(!"invalid Primitive::Kind");
 	}
 }
 
-float evaluate(Scene const &scene, Object const &object, Vector2 point) {
+static EvalContext &get_thread_context() {
+	thread_local EvalContext context;
+	return context;
+}
+
+// Invalidates all cached primitive results in context and makes room for primitive_count of them.
+static uint32_t next_generation(EvalContext &context, std::size_t primitive_count) {
+	if (context.primitive_generations.size() < primitive_count) {
+		context.primitive_generations.resize(primitive_count, 0);
+		context.primitive_results.resize(primitive_count);
+	}
+	if (++context.generation == 0) {
+		std::fill(context.primitive_generations.begin(), context.primitive_generations.end(), 0);
+		std::fill(context.operation_generations.begin(), context.operation_generations.end(), 0);
+		context.generation = 1;
+	}
+	return context.generation;
+}
+
+float evaluate(Scene const &scene, Object const &object, Vector2 point, EvalPrecision precision) {
+	return evaluate(get_thread_context(), scene, object, point, precision);
+}
+
+float evaluate(EvalContext &context, Scene const &scene, Object const &object, Vector2 point, EvalPrecision precision) {
 	if (object.operations.size() == 0) {
 		if (object.primitives.size() == 0) {
 			return std::numeric_limits<float>::infinity();
 		}
 
-		return evaluate(scene, object.primitives.back(), point);
+		return evaluate(scene, object.primitives.back(), point, precision);
 	}
 
-	std::vector<float> operation_results;
-	operation_results.resize(object.operations.size(), std::numeric_limits<float>::quiet_NaN());
+	if (context.operation_results.size() < object.operations.size()) {
+		context.operation_results.resize(object.operations.size());
+	}
+	float *operation_results = context.operation_results.data();
+
+	uint32_t generation = next_generation(context, object.primitives.size());
+	float *primitive_results = context.primitive_results.data();
+	uint32_t *primitive_generations = context.primitive_generations.data();
+
+	std::size_t operation_index = 0;
 
 	auto evaluate_argument = [&](ArgumentIndex index) -> float {
 		switch (index.kind) {
 			default:
 			case ArgumentIndex::Kind::object_primitive: {
-				return evaluate(scene, object.primitives[index.value], point);
+				if (primitive_generations[index.value] != generation) {
+					primitive_results[index.value] = evaluate(scene, object.primitives[index.value], point, precision);
+					primitive_generations[index.value] = generation;
+				}
+				return primitive_results[index.value];
 			}
 			case ArgumentIndex::Kind::object_operation: {
+				// Results of this and following operations are left from previous calls.
+				if (index.value >= operation_index)
+					return std::numeric_limits<float>::quiet_NaN();
 				return operation_results[index.value];
 			}
 		}
 	};
 
-	for (std::size_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+	for (; operation_index < object.operations.size(); ++operation_index) {
 		auto &operation = object.operations[operation_index];
 
 		auto evaluate_min = [&] {
@@ -503,6 +2008,23 @@ float evaluate(Scene const &scene, Object const &object, Vector2 point) {
 		auto evaluate_neg = [&] {
 			return -evaluate_argument(operation.args[0]);
 		};
+		auto evaluate_range = [&](auto fold) {
+			if (!is_valid_range(operation))
+				return std::numeric_limits<float>::quiet_NaN();
+			float result = evaluate_argument(operation.args[0]);
+			for (uint32_t value = operation.args[0].value + 1; value <= operation.args[1].value; ++value) {
+				result = fold(result, evaluate_argument({.kind = operation.args[0].kind, .value = value}));
+			}
+			return result;
+		};
+		auto evaluate_min_range = [&] { return evaluate_range([](float a, float b) { return std::min(a, b); }); };
+		auto evaluate_max_range = [&] { return evaluate_range([](float a, float b) { return std::max(a, b); }); };
+		auto evaluate_max_neg = [&] {
+			return std::max(
+				evaluate_argument(operation.args[0]),
+				-evaluate_argument(operation.args[1])
+			);
+		};
 
 		switch (operation.kind) {
 			#define x(name, value, arity) case Operation::Kind::name: operation_results[operation_index] = evaluate_##name(); break;
@@ -513,9 +2035,3491 @@ float evaluate(Scene const &scene, Object const &object, Vector2 point) {
 				assert(!"invalid Operation::Kind");
 		}
 	}
-	return operation_results.back();
+	return operation_results[object.operations.size() - 1];
+}
+
+// Relative cost of evaluating primitive, used to pick which argument is tested first.
+static uint32_t get_cost(Scene const &scene, Primitive const &primitive) {
+	switch (primitive.kind) {
+		case Primitive::Kind::float1: return 0;
+		case Primitive::Kind::plane:  return 1;
+		case Primitive::Kind::circle: return scene.scale.x == scene.scale.y ? 2 : 4;
+		default:                      return 4;
+	}
+}
+
+// Bits of operation costs that tell if the operation is used by more than one argument.
+static constexpr uint32_t operation_used_bit = 1u << 31;
+static constexpr uint32_t operation_shared_bit = 1u << 30;
+static constexpr uint32_t operation_cost_mask = operation_shared_bit - 1;
+
+// Writes cost of evaluating every operation with all of its arguments to costs.
+// Shared arguments are counted every time, which is fine for ordering.
+// Operations used more than once also get operation_shared_bit.
+static void compute_operation_costs(Scene const &scene, Object const &object, uint32_t *costs) {
+	for (uint32_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		auto &operation = object.operations[operation_index];
+
+		auto get_argument_cost = [&](ArgumentIndex index) -> uint32_t {
+			if (index.kind == ArgumentIndex::Kind::object_primitive)
+				return get_cost(scene, object.primitives[index.value]);
+			if (index.value >= operation_index)
+				return 0;
+
+			costs[index.value] |= costs[index.value] & operation_used_bit ? operation_shared_bit : operation_used_bit;
+			return costs[index.value] & operation_cost_mask;
+		};
+
+		uint32_t cost = 1;
+		for_each_argument(operation, [&](ArgumentIndex index) {
+			cost = std::min(cost + get_argument_cost(index), operation_cost_mask);
+		});
+		costs[operation_index] = cost;
+	}
+}
+
+// is_inside does not nest deeper than this, it evaluates the whole object instead.
+static constexpr uint32_t max_inside_depth = 1024;
+
+struct InsideState {
+	Scene const &scene;
+	Object const &object;
+	Vector2 point;
+	uint32_t generation;
+	float *primitive_results;
+	uint32_t *primitive_generations;
+	uint8_t *operation_signs;
+	uint32_t *operation_generations;
+	uint32_t const *operation_costs;
+	std::vector<uint32_t> &pending;
+	EvalPrecision precision;
+	bool too_deep;
+};
+
+static uint32_t get_cost(InsideState &state, ArgumentIndex index) {
+	if (index.kind == ArgumentIndex::Kind::object_primitive)
+		return get_cost(state.scene, state.object.primitives[index.value]);
+	// Invalid references, like the ones left by deduplicate and fuse, can be past the end.
+	if (index.value >= state.object.operations.size())
+		return 0;
+	return state.operation_costs[index.value] & operation_cost_mask;
+}
+
+static bool test_primitive(InsideState &state, uint32_t primitive_index, bool positive) {
+	if (state.primitive_generations[primitive_index] != state.generation) {
+		state.primitive_results[primitive_index] = evaluate(state.scene, state.object.primitives[primitive_index], state.point, state.precision);
+		state.primitive_generations[primitive_index] = state.generation;
+	}
+	float value = state.primitive_results[primitive_index];
+	return positive ? value > 0 : value < 0;
+}
+
+static bool is_inside(InsideState &state, ArgumentIndex index, uint32_t user, bool positive, uint32_t depth);
+
+// Tests arguments of min_range or max_range in order until one decides the answer.
+static bool is_inside_range(InsideState &state, Operation const &operation, uint32_t user, bool positive, uint32_t depth) {
+	// evaluate gives NaN for invalid ranges, neither query is true for it.
+	if (!is_valid_range(operation))
+		return false;
+
+	bool any = (operation.kind == Operation::Kind::min_range) != positive;
+	for (uint32_t value = operation.args[0].value; value <= operation.args[1].value; ++value) {
+		ArgumentIndex index = {.kind = operation.args[0].kind, .value = value};
+		bool result;
+		if (index.kind == ArgumentIndex::Kind::object_primitive) {
+			result = test_primitive(state, index.value, positive);
+		} else if (depth == max_inside_depth) {
+			state.too_deep = true;
+			return false;
+		} else {
+			result = is_inside(state, index, user, positive, depth + 1);
+		}
+		if (result == any)
+			return any;
+	}
+	return !any;
 }
 
+// Returns whether value of index is < 0, or > 0 if positive is true.
+// user is the operation that has index as an argument.
+static bool is_inside(InsideState &state, ArgumentIndex index, uint32_t user, bool positive, uint32_t depth) {
+	// Bit 0 of operation_signs tells if the answer to "< 0" is known and bit 1
+	// is the answer. Bits 2 and 3 are the same for "> 0".
+	auto get_known_bit = [](bool positive) -> uint8_t { return positive ? 4 : 1; };
+
+	// When the first argument of min or max does not decide the answer, the
+	// second one does. It is followed in this loop rather than recursively, so
+	// long chains of operations do not nest. Shared operations passed this way
+	// are kept in state.pending with the query they got, and all get the final
+	// answer. Others are visited once, so their answers are not kept.
+	std::size_t pending_begin = state.pending.size();
+
+	bool result;
+	while (true) {
+		if (index.kind == ArgumentIndex::Kind::object_primitive) {
+			result = test_primitive(state, index.value, positive);
+			break;
+		}
+
+		// evaluate gives NaN for forward references, neither query is true for it.
+		if (index.value >= user) {
+			result = false;
+			break;
+		}
+
+		if (state.operation_costs[index.value] & operation_shared_bit) {
+			uint8_t known_bit = get_known_bit(positive);
+			if (state.operation_generations[index.value] == state.generation && (state.operation_signs[index.value] & known_bit)) {
+				result = state.operation_signs[index.value] & (known_bit << 1);
+				break;
+			}
+
+			state.pending.push_back(index.value << 1 | positive);
+		}
+
+		Operation const &operation = state.object.operations[index.value];
+		user = index.value;
+
+		if (operation.kind == Operation::Kind::neg) {
+			index = operation.args[0];
+			positive = !positive;
+			continue;
+		}
+
+		if (is_range(operation.kind)) {
+			result = is_inside_range(state, operation, user, positive, depth);
+			break;
+		}
+
+		// max_neg is max with the query for the second argument flipped.
+		ArgumentIndex first = operation.args[0];
+		ArgumentIndex second = operation.args[1];
+		bool first_positive = positive;
+		bool second_positive = operation.kind == Operation::Kind::max_neg ? !positive : positive;
+		if (get_cost(state, second) < get_cost(state, first)) {
+			std::swap(first, second);
+			std::swap(first_positive, second_positive);
+		}
+
+		bool first_result;
+		if (first.kind == ArgumentIndex::Kind::object_primitive) {
+			first_result = test_primitive(state, first.value, first_positive);
+		} else if (depth == max_inside_depth) {
+			state.too_deep = true;
+			result = false;
+			break;
+		} else {
+			first_result = is_inside(state, first, user, first_positive, depth + 1);
+		}
+
+		// min < 0 and max > 0 if either argument is, otherwise both have to be.
+		bool any = (operation.kind == Operation::Kind::min) != positive;
+		if (first_result == any) {
+			result = first_result;
+			break;
+		}
+
+		index = second;
+		positive = second_positive;
+	}
+
+	for (std::size_t i = pending_begin; i < state.pending.size(); ++i) {
+		uint32_t operation_index = state.pending[i] >> 1;
+		uint8_t known_bit = get_known_bit(state.pending[i] & 1);
+		if (state.operation_generations[operation_index] != state.generation) {
+			state.operation_generations[operation_index] = state.generation;
+			state.operation_signs[operation_index] = 0;
+		}
+		state.operation_signs[operation_index] |= known_bit | (result ? known_bit << 1 : 0);
+	}
+	state.pending.resize(pending_begin);
+
+	return result;
+}
+
+// operation_costs are from compute_operation_costs.
+static bool is_inside(EvalContext &context, Scene const &scene, Object const &object, Vector2 point, uint32_t const *operation_costs, EvalPrecision precision) {
+	if (object.operations.size() == 0) {
+		if (object.primitives.size() == 0) {
+			return false;
+		}
+
+		return evaluate(scene, object.primitives.back(), point, precision) < 0;
+	}
+
+	uint32_t operation_count = object.operations.size();
+
+	InsideState state = {
+		.scene = scene,
+		.object = object,
+		.point = point,
+		.generation = next_generation(context, object.primitives.size()),
+		.primitive_results = context.primitive_results.data(),
+		.primitive_generations = context.primitive_generations.data(),
+		.operation_signs = context.operation_signs.data(),
+		.operation_generations = context.operation_generations.data(),
+		.operation_costs = operation_costs,
+		.pending = context.inside_pending,
+		.precision = precision,
+		.too_deep = false,
+	};
+
+	bool result = is_inside(state, object_operation_index(operation_count - 1), operation_count, false, 0);
+	if (state.too_deep)
+		return evaluate(context, scene, object, point, precision) < 0;
+	return result;
+}
+
+// Makes room for is_inside scratch data for object.
+static void reserve_is_inside(EvalContext &context, Object const &object) {
+	std::size_t operation_count = object.operations.size();
+	if (context.operation_generations.size() < operation_count) {
+		context.operation_generations.resize(operation_count, 0);
+		context.operation_signs.resize(operation_count);
+		context.operation_costs.resize(operation_count);
+	}
+}
+
+// Returns operation costs of object, computing them only if the context has
+// them for another object.
+static uint32_t const *get_operation_costs(EvalContext &context, Scene const &scene, Object const &object) {
+	bool uniform_scale = scene.scale.x == scene.scale.y;
+	if (context.costs_object != &object ||
+		context.costs_primitives != object.primitives.data() ||
+		context.costs_operations != object.operations.data() ||
+		context.costs_primitive_count != object.primitives.size() ||
+		context.costs_operation_count != object.operations.size() ||
+		context.costs_uniform_scale != uniform_scale)
+	{
+		reserve_is_inside(context, object);
+		compute_operation_costs(scene, object, context.operation_costs.data());
+		context.costs_object = &object;
+		context.costs_primitives = object.primitives.data();
+		context.costs_operations = object.operations.data();
+		context.costs_primitive_count = object.primitives.size();
+		context.costs_operation_count = object.operations.size();
+		context.costs_uniform_scale = uniform_scale;
+	}
+	return context.operation_costs.data();
+}
+
+bool is_inside(Scene const &scene, Object const &object, Vector2 point, EvalPrecision precision) {
+	return is_inside(get_thread_context(), scene, object, point, precision);
+}
+
+bool is_inside(EvalContext &context, Scene const &scene, Object const &object, Vector2 point, EvalPrecision precision) {
+	uint32_t const *operation_costs = get_operation_costs(context, scene, object);
+	return is_inside(context, scene, object, point, operation_costs, precision);
+}
+
+void is_inside_batch(Scene const &scene, Object const &object, std::span<Vector2 const> points, std::span<bool> out, EvalPrecision precision) {
+	is_inside_batch(get_thread_context(), scene, object, points, out, precision);
+}
+
+void is_inside_batch(EvalContext &context, Scene const &scene, Object const &object, std::span<Vector2 const> points, std::span<bool> out, EvalPrecision precision) {
+	assert(out.size() >= points.size());
+
+	uint32_t const *operation_costs = get_operation_costs(context, scene, object);
+	for (std::size_t i = 0; i < points.size(); ++i) {
+		out[i] = is_inside(context, scene, object, points[i], operation_costs, precision);
+	}
+}
+
+//
+// SIMD kernels
+//
+// Kernels are written once as templates over a lane type and instantiated
+// for every instruction set. Instantiations for instruction sets that are not
+// enabled for the whole translation unit are compiled in wrappers with target
+// attributes, which get everything inlined into them.
+// The best set supported by the cpu is picked on first use.
+//
+
+// Single float, used when no SIMD is available.
+struct F32x1 {
+	static constexpr std::size_t width = 1;
+	float v;
+
+	static F32x1 broadcast(float x) { return {x}; }
+	static F32x1 load(float const *p) { return {*p}; }
+	static F32x1 load_partial(float const *p, std::size_t) { return {*p}; }
+	void store(float *p) const { *p = v; }
+	void store_partial(float *p, std::size_t) const { *p = v; }
+};
+
+static F32x1 operator+(F32x1 a, F32x1 b) { return {a.v + b.v}; }
+static F32x1 operator-(F32x1 a, F32x1 b) { return {a.v - b.v}; }
+static F32x1 operator*(F32x1 a, F32x1 b) { return {a.v * b.v}; }
+static F32x1 operator-(F32x1 a) { return {-a.v}; }
+static F32x1 min(F32x1 a, F32x1 b) { return {std::min(a.v, b.v)}; }
+static F32x1 max(F32x1 a, F32x1 b) { return {std::max(a.v, b.v)}; }
+static F32x1 operator/(F32x1 a, F32x1 b) { return {a.v / b.v}; }
+static F32x1 sqrt(F32x1 a) { return {sqrtf(a.v)}; }
+static F32x1 abs(F32x1 a) { return {fabsf(a.v)}; }
+
+// Masks are lanes with all bits set where the condition is true.
+static F32x1 less(F32x1 a, F32x1 b) {
+	uint32_t bits = a.v < b.v ? ~0u : 0u;
+	F32x1 r;
+	memcpy(&r.v, &bits, sizeof(bits));
+	return r;
+}
+static F32x1 select(F32x1 mask, F32x1 a, F32x1 b) {
+	uint32_t bits;
+	memcpy(&bits, &mask.v, sizeof(bits));
+	return bits ? a : b;
+}
+static bool any(F32x1 mask) {
+	uint32_t bits;
+	memcpy(&bits, &mask.v, sizeof(bits));
+	return bits;
+}
+static bool all(F32x1 mask) { return any(mask); }
+
+// Reinterprets bits of a as int32 and converts that to float.
+static F32x1 bits_to_float(F32x1 a) {
+	int32_t bits;
+	memcpy(&bits, &a.v, sizeof(bits));
+	return {(float)bits};
+}
+// Converts a to int32, truncating, and reinterprets it as float.
+static F32x1 float_to_bits(F32x1 a) {
+	int32_t bits = (int32_t)a.v;
+	F32x1 r;
+	memcpy(&r.v, &bits, sizeof(bits));
+	return r;
+}
+
+#if SDFD_SIMD_X86
+
+#if defined(_MSC_VER) && !defined(__clang__)
+// MSVC allows intrinsics for any instruction set anywhere.
+#define SDFD_TARGET_AVX2
+#define SDFD_TARGET_AVX512
+#define SDFD_FLATTEN
+#else
+#define SDFD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SDFD_TARGET_AVX512 __attribute__((target("avx512f")))
+#define SDFD_FLATTEN __attribute__((flatten))
+#endif
+
+// Note that min and max match std::min and std::max when an argument is NaN.
+
+struct F32x4 {
+	static constexpr std::size_t width = 4;
+	__m128 v;
+
+	static F32x4 broadcast(float x) { return {_mm_set1_ps(x)}; }
+	static F32x4 load(float const *p) { return {_mm_loadu_ps(p)}; }
+	static F32x4 load_partial(float const *p, std::size_t n) {
+		float buffer[width] = {};
+		memcpy(buffer, p, n * sizeof(float));
+		return load(buffer);
+	}
+	void store(float *p) const { _mm_storeu_ps(p, v); }
+	void store_partial(float *p, std::size_t n) const {
+		float buffer[width];
+		store(buffer);
+		memcpy(p, buffer, n * sizeof(float));
+	}
+};
+
+static F32x4 operator+(F32x4 a, F32x4 b) { return {_mm_add_ps(a.v, b.v)}; }
+static F32x4 operator-(F32x4 a, F32x4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+static F32x4 operator*(F32x4 a, F32x4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+static F32x4 operator-(F32x4 a) { return {_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))}; }
+static F32x4 min(F32x4 a, F32x4 b) { return {_mm_min_ps(b.v, a.v)}; }
+static F32x4 max(F32x4 a, F32x4 b) { return {_mm_max_ps(b.v, a.v)}; }
+static F32x4 operator/(F32x4 a, F32x4 b) { return {_mm_div_ps(a.v, b.v)}; }
+static F32x4 sqrt(F32x4 a) { return {_mm_sqrt_ps(a.v)}; }
+static F32x4 abs(F32x4 a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+static F32x4 less(F32x4 a, F32x4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+static F32x4 select(F32x4 mask, F32x4 a, F32x4 b) { return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))}; }
+static bool any(F32x4 mask) { return _mm_movemask_ps(mask.v) != 0; }
+static bool all(F32x4 mask) { return _mm_movemask_ps(mask.v) == 0xf; }
+static F32x4 bits_to_float(F32x4 a) { return {_mm_cvtepi32_ps(_mm_castps_si128(a.v))}; }
+static F32x4 float_to_bits(F32x4 a) { return {_mm_castsi128_ps(_mm_cvttps_epi32(a.v))}; }
+
+// Wider lanes are stored as arrays, because generic kernels are not compiled
+// for their instruction set and would pass vector registers between functions
+// with mismatching calling conventions. Once a kernel is inlined into its
+// target wrapper the arrays are kept in registers.
+
+struct F32x8 {
+	static constexpr std::size_t width = 8;
+	float v[width];
+
+	SDFD_TARGET_AVX2 static F32x8 from(__m256 m) { F32x8 r; _mm256_storeu_ps(r.v, m); return r; }
+	SDFD_TARGET_AVX2 __m256 get() const { return _mm256_loadu_ps(v); }
+
+	SDFD_TARGET_AVX2 static F32x8 broadcast(float x) { return from(_mm256_set1_ps(x)); }
+	SDFD_TARGET_AVX2 static F32x8 load(float const *p) { return from(_mm256_loadu_ps(p)); }
+	SDFD_TARGET_AVX2 static F32x8 load_partial(float const *p, std::size_t n) {
+		F32x8 r = {};
+		memcpy(r.v, p, n * sizeof(float));
+		return r;
+	}
+	SDFD_TARGET_AVX2 void store(float *p) const { _mm256_storeu_ps(p, get()); }
+	SDFD_TARGET_AVX2 void store_partial(float *p, std::size_t n) const { memcpy(p, v, n * sizeof(float)); }
+};
+
+SDFD_TARGET_AVX2 static F32x8 operator+(F32x8 a, F32x8 b) { return F32x8::from(_mm256_add_ps(a.get(), b.get())); }
+SDFD_TARGET_AVX2 static F32x8 operator-(F32x8 a, F32x8 b) { return F32x8::from(_mm256_sub_ps(a.get(), b.get())); }
+SDFD_TARGET_AVX2 static F32x8 operator*(F32x8 a, F32x8 b) { return F32x8::from(_mm256_mul_ps(a.get(), b.get())); }
+SDFD_TARGET_AVX2 static F32x8 operator-(F32x8 a) { return F32x8::from(_mm256_xor_ps(a.get(), _mm256_set1_ps(-0.0f))); }
+SDFD_TARGET_AVX2 static F32x8 min(F32x8 a, F32x8 b) { return F32x8::from(_mm256_min_ps(b.get(), a.get())); }
+SDFD_TARGET_AVX2 static F32x8 max(F32x8 a, F32x8 b) { return F32x8::from(_mm256_max_ps(b.get(), a.get())); }
+SDFD_TARGET_AVX2 static F32x8 operator/(F32x8 a, F32x8 b) { return F32x8::from(_mm256_div_ps(a.get(), b.get())); }
+SDFD_TARGET_AVX2 static F32x8 sqrt(F32x8 a) { return F32x8::from(_mm256_sqrt_ps(a.get())); }
+SDFD_TARGET_AVX2 static F32x8 abs(F32x8 a) { return F32x8::from(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.get())); }
+SDFD_TARGET_AVX2 static F32x8 less(F32x8 a, F32x8 b) { return F32x8::from(_mm256_cmp_ps(a.get(), b.get(), _CMP_LT_OQ)); }
+SDFD_TARGET_AVX2 static F32x8 select(F32x8 mask, F32x8 a, F32x8 b) { return F32x8::from(_mm256_blendv_ps(b.get(), a.get(), mask.get())); }
+SDFD_TARGET_AVX2 static bool any(F32x8 mask) { return _mm256_movemask_ps(mask.get()) != 0; }
+SDFD_TARGET_AVX2 static bool all(F32x8 mask) { return _mm256_movemask_ps(mask.get()) == 0xff; }
+SDFD_TARGET_AVX2 static F32x8 bits_to_float(F32x8 a) { return F32x8::from(_mm256_cvtepi32_ps(_mm256_castps_si256(a.get()))); }
+SDFD_TARGET_AVX2 static F32x8 float_to_bits(F32x8 a) { return F32x8::from(_mm256_castsi256_ps(_mm256_cvttps_epi32(a.get()))); }
+
+struct F32x16 {
+	static constexpr std::size_t width = 16;
+	float v[width];
+
+	SDFD_TARGET_AVX512 static F32x16 from(__m512 m) { F32x16 r; _mm512_storeu_ps(r.v, m); return r; }
+	SDFD_TARGET_AVX512 __m512 get() const { return _mm512_loadu_ps(v); }
+
+	SDFD_TARGET_AVX512 static F32x16 broadcast(float x) { return from(_mm512_set1_ps(x)); }
+	SDFD_TARGET_AVX512 static F32x16 load(float const *p) { return from(_mm512_loadu_ps(p)); }
+	SDFD_TARGET_AVX512 static F32x16 load_partial(float const *p, std::size_t n) { return from(_mm512_maskz_loadu_ps((__mmask16)((1u << n) - 1), p)); }
+	SDFD_TARGET_AVX512 void store(float *p) const { _mm512_storeu_ps(p, get()); }
+	SDFD_TARGET_AVX512 void store_partial(float *p, std::size_t n) const { _mm512_mask_storeu_ps(p, (__mmask16)((1u << n) - 1), get()); }
+};
+
+SDFD_TARGET_AVX512 static F32x16 operator+(F32x16 a, F32x16 b) { return F32x16::from(_mm512_add_ps(a.get(), b.get())); }
+SDFD_TARGET_AVX512 static F32x16 operator-(F32x16 a, F32x16 b) { return F32x16::from(_mm512_sub_ps(a.get(), b.get())); }
+SDFD_TARGET_AVX512 static F32x16 operator*(F32x16 a, F32x16 b) { return F32x16::from(_mm512_mul_ps(a.get(), b.get())); }
+SDFD_TARGET_AVX512 static F32x16 operator-(F32x16 a) { return F32x16::from(_mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a.get()), _mm512_set1_epi32(0x80000000)))); }
+// Zero-masked versions with full mask, because GCC warns about uninitialized
+// values in unmasked ones.
+SDFD_TARGET_AVX512 static F32x16 min(F32x16 a, F32x16 b) { return F32x16::from(_mm512_maskz_min_ps(0xffff, b.get(), a.get())); }
+SDFD_TARGET_AVX512 static F32x16 max(F32x16 a, F32x16 b) { return F32x16::from(_mm512_maskz_max_ps(0xffff, b.get(), a.get())); }
+SDFD_TARGET_AVX512 static F32x16 sqrt(F32x16 a) { return F32x16::from(_mm512_maskz_sqrt_ps(0xffff, a.get())); }
+SDFD_TARGET_AVX512 static F32x16 operator/(F32x16 a, F32x16 b) { return F32x16::from(_mm512_maskz_div_ps(0xffff, a.get(), b.get())); }
+SDFD_TARGET_AVX512 static F32x16 abs(F32x16 a) { return F32x16::from(_mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a.get()), _mm512_set1_epi32(0x7fffffff)))); }
+SDFD_TARGET_AVX512 static F32x16 less(F32x16 a, F32x16 b) { return F32x16::from(_mm512_castsi512_ps(_mm512_maskz_set1_epi32(_mm512_cmp_ps_mask(a.get(), b.get(), _CMP_LT_OQ), -1))); }
+SDFD_TARGET_AVX512 static F32x16 select(F32x16 mask, F32x16 a, F32x16 b) {
+	__m512i bits = _mm512_castps_si512(mask.get());
+	return F32x16::from(_mm512_mask_blend_ps(_mm512_test_epi32_mask(bits, bits), b.get(), a.get()));
+}
+SDFD_TARGET_AVX512 static bool any(F32x16 mask) {
+	__m512i bits = _mm512_castps_si512(mask.get());
+	return _mm512_test_epi32_mask(bits, bits) != 0;
+}
+SDFD_TARGET_AVX512 static bool all(F32x16 mask) {
+	__m512i bits = _mm512_castps_si512(mask.get());
+	return _mm512_test_epi32_mask(bits, bits) == 0xffff;
+}
+SDFD_TARGET_AVX512 static F32x16 bits_to_float(F32x16 a) { return F32x16::from(_mm512_maskz_cvtepi32_ps(0xffff, _mm512_castps_si512(a.get()))); }
+SDFD_TARGET_AVX512 static F32x16 float_to_bits(F32x16 a) { return F32x16::from(_mm512_castsi512_ps(_mm512_maskz_cvttps_epi32(0xffff, a.get()))); }
+
+#if defined(_MSC_VER) && !defined(__clang__)
+static bool cpu_supports(int leaf7_ebx_bit, unsigned long long xcr0_mask) {
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// OSXSAVE, the os must save the registers on context switch.
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)))
+		return false;
+	if ((_xgetbv(0) & xcr0_mask) != xcr0_mask)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return info[1] & (1 << leaf7_ebx_bit);
+}
+static bool cpu_supports_avx2()    { return cpu_supports(5, 0x06); }
+static bool cpu_supports_avx512f() { return cpu_supports(16, 0xe6); }
+#else
+static bool cpu_supports_avx2()    { return __builtin_cpu_supports("avx2"); }
+static bool cpu_supports_avx512f() { return __builtin_cpu_supports("avx512f"); }
+#endif
+
+#endif // SDFD_SIMD_X86
+
+//
+// Fast math
+//
+// Approximations written over lane types, so the same code runs in scalar
+// functions through F32x1 and in SIMD kernels. They are used by distance_fast
+// instead of libm calls, which do not vectorize. Errors are the largest ones
+// measured against double precision libm over the whole range given, inputs outside of it are
+// not supported. Square root is not approximated, the instruction is exact
+// and vectorizes already.
+//
+
+// acos on [-1, 1], Hastings' polynomial from Abramowitz and Stegun 4.4.45.
+// Absolute error below 7e-5.
+template <class F>
+static F fast_acos(F x) {
+	F one = F::broadcast(1);
+	F a = min(abs(x), one);
+	F p = F::broadcast(-0.0187293f);
+	p = p*a + F::broadcast(0.0742610f);
+	p = p*a + F::broadcast(-0.2121144f);
+	p = p*a + F::broadcast(1.5707288f);
+	F r = sqrt(one - a) * p;
+	return select(less(x, F::broadcast(0)), F::broadcast(3.14159265f) - r, r);
+}
+
+// cos and sin on [0, pi/3], which is the range acos / 3 gives.
+// Taylor series, absolute error below 6e-7.
+template <class F>
+static F fast_cos(F x) {
+	F x2 = x*x;
+	F p = F::broadcast(1/40320.0f);
+	p = p*x2 + F::broadcast(-1/720.0f);
+	p = p*x2 + F::broadcast(1/24.0f);
+	p = p*x2 + F::broadcast(-1/2.0f);
+	return p*x2 + F::broadcast(1);
+}
+template <class F>
+static F fast_sin(F x) {
+	F x2 = x*x;
+	F p = F::broadcast(1/362880.0f);
+	p = p*x2 + F::broadcast(-1/5040.0f);
+	p = p*x2 + F::broadcast(1/120.0f);
+	p = p*x2 + F::broadcast(-1/6.0f);
+	return (p*x2 + F::broadcast(1)) * x;
+}
+
+// Cube root of normal floats. Dividing the bits by 3 and adding a bias
+// divides the exponent by 3, which is within 4% of the root, then two Newton
+// steps bring relative error below 2e-6. Gives about 1e-13 for zero and denormals.
+template <class F>
+static F fast_cbrt(F x) {
+	F a = abs(x);
+	F y = float_to_bits(bits_to_float(a) * F::broadcast(1/3.0f) + F::broadcast(0x2a5137a0));
+	F third = F::broadcast(1/3.0f);
+	F two = F::broadcast(2);
+	y = (two*y + a/(y*y)) * third;
+	y = (two*y + a/(y*y)) * third;
+	return select(less(x, F::broadcast(0)), -y, y);
+}
+
+// distance_fast for a lane of points. Same steps as distance(Ellipse), but
+// both of its branches are computed and the right one is selected per lane.
+template <class F>
+static F fast_ellipse_distance(Ellipse e, F x, F y) {
+	F zero = F::broadcast(0);
+	F cx = F::broadcast(e.center.x);
+	F cy = F::broadcast(e.center.y);
+
+	// Equal radii do not depend on the point, so they are handled for the whole lane.
+	if (fabsf((e.radius.y - e.radius.x)*(e.radius.y + e.radius.x)) < 1e-9f) {
+		F dx = x - cx;
+		F dy = y - cy;
+		return sqrt(dx*dx + dy*dy) - F::broadcast(e.radius.y);
+	}
+
+	F rx = F::broadcast(e.radius.x);
+	F ry = F::broadcast(e.radius.y);
+	F px = abs(x - cx);
+	F py = abs(y - cy);
+
+	// Solved in the half of the quadrant where p.x <= p.y.
+	F swap = less(py, px);
+	F ax = select(swap, ry, rx);
+	F ay = select(swap, rx, ry);
+	F qx = select(swap, py, px);
+	F qy = select(swap, px, py);
+
+	F l = (ay - ax)*(ay + ax);
+	F m = ax*qx/l;
+	F n = ay*qy/l;
+	F m2 = m*m;
+	F n2 = n*n;
+
+	F c = (m2 + n2 - F::broadcast(1)) * F::broadcast(1/3.0f);
+	F c3 = c*c*c;
+
+	F d = c3 + m2*n2;
+	F q = d + m2*n2;
+	F g = m + m*n2;
+
+	F sqrt3 = F::broadcast(1.7320508f);
+
+	// A branch is skipped when no lane takes it. Nearby points usually take the
+	// same one, and F32x1 does not pay for both.
+	F negative_d = less(d, zero);
+	F co0 = zero;
+	F co1 = zero;
+	if (any(negative_d)) {
+		F h = fast_acos(q/c3) * F::broadcast(1/3.0f);
+		F s = fast_cos(h) + F::broadcast(2);
+		F t = fast_sin(h) * sqrt3;
+		F rx0 = sqrt(m2 - c*(s + t));
+		F ry0 = sqrt(m2 - c*(s - t));
+		co0 = ry0 + select(less(l, zero), -rx0, rx0) + abs(g)/(rx0*ry0);
+	}
+	if (!all(negative_d)) {
+		F h = F::broadcast(2)*m*n*sqrt(d);
+		F s = fast_cbrt(q + h);
+		F t = fast_cbrt(q - h);
+		F rx1 = F::broadcast(2)*m2 - (s + t) - c*F::broadcast(4);
+		F ry1 = (s - t) * sqrt3;
+		F rm = sqrt(rx1*rx1 + ry1*ry1);
+		co1 = ry1/sqrt(rm - rx1) + F::broadcast(2)*g/rm;
+	}
+
+	F co = (select(negative_d, co0, co1) - m) * F::broadcast(0.5f);
+	F si = sqrt(max(F::broadcast(1) - co*co, zero));
+
+	// Same Newton step as in distance(Ellipse).
+	F f = l*si*co + ax*qx*si - ay*qy*co;
+	F df = l*(co*co - si*si) + ax*qx*co + ay*qy*si;
+	F step = select(less(zero, df), f/df, zero);
+	F co2 = co + si*step;
+	F si2 = si - co*step;
+	F inverse_length = F::broadcast(1) / sqrt(co2*co2 + si2*si2);
+	co = co2 * inverse_length;
+	si = si2 * inverse_length;
+
+	F dx = ax*co - qx;
+	F dy = ay*si - qy;
+	F nearest_distance = sqrt(dx*dx + dy*dy);
+
+	F ux = (x - cx) / rx;
+	F uy = (y - cy) / ry;
+	return select(less(ux*ux + uy*uy, F::broadcast(1)), -nearest_distance, nearest_distance);
+}
+
+float distance_fast(Ellipse e, Vector2 p) {
+	return fast_ellipse_distance(e, F32x1{p.x}, F32x1{p.y}).v;
+}
+
+// Applies fn to inputs lane by lane and stores the results to out.
+// The tail is padded to the full width.
+template <class F, class Fn, class ...Inputs>
+static void map_lanes(float *out, std::size_t count, Fn fn, Inputs const *...inputs) {
+	std::size_t i = 0;
+	for (; i + F::width <= count; i += F::width) {
+		fn(F::load(inputs + i)...).store(out + i);
+	}
+	if (i < count) {
+		fn(F::load_partial(inputs + i, count - i)...).store_partial(out + i, count - i);
+	}
+}
+
+template <class F>
+static void plane_kernel(Plane plane, float const *xs, float const *ys, float *out, std::size_t count) {
+	F nx = F::broadcast(plane.normal.x);
+	F ny = F::broadcast(plane.normal.y);
+	F offset = F::broadcast(plane.offset);
+	map_lanes<F>(out, count, [&](F x, F y) { return nx*x + ny*y - offset; }, xs, ys);
+}
+
+template <class F>
+static void circle_kernel(Circle circle, float const *xs, float const *ys, float *out, std::size_t count) {
+	F cx = F::broadcast(circle.center.x);
+	F cy = F::broadcast(circle.center.y);
+	F radius = F::broadcast(circle.radius);
+	map_lanes<F>(out, count, [&](F x, F y) {
+		F dx = x - cx;
+		F dy = y - cy;
+		return sqrt(dx*dx + dy*dy) - radius;
+	}, xs, ys);
+}
+
+// Kernels below fold distances to a primitive into a: out is max(a, distance)
+// if is_max is true and min(a, distance) otherwise.
+
+template <class F, class Distance>
+static void fold_lanes(bool is_max, float const *xs, float const *ys, float const *a, float *out, std::size_t count, Distance distance) {
+	if (is_max) {
+		map_lanes<F>(out, count, [&](F x, F y, F a) { return max(a, distance(x, y)); }, xs, ys, a);
+	} else {
+		map_lanes<F>(out, count, [&](F x, F y, F a) { return min(a, distance(x, y)); }, xs, ys, a);
+	}
+}
+
+template <class F>
+static void plane_fold_kernel(Plane plane, bool is_max, float const *xs, float const *ys, float const *a, float *out, std::size_t count) {
+	F nx = F::broadcast(plane.normal.x);
+	F ny = F::broadcast(plane.normal.y);
+	F offset = F::broadcast(plane.offset);
+	fold_lanes<F>(is_max, xs, ys, a, out, count, [&](F x, F y) { return nx*x + ny*y - offset; });
+}
+
+template <class F>
+static void circle_fold_kernel(Circle circle, bool is_max, float const *xs, float const *ys, float const *a, float *out, std::size_t count) {
+	F cx = F::broadcast(circle.center.x);
+	F cy = F::broadcast(circle.center.y);
+	F radius = F::broadcast(circle.radius);
+	fold_lanes<F>(is_max, xs, ys, a, out, count, [&](F x, F y) {
+		F dx = x - cx;
+		F dy = y - cy;
+		return sqrt(dx*dx + dy*dy) - radius;
+	});
+}
+
+// Kernels below evaluate many primitives stored as in Program at one point.
+
+template <class F>
+static void planes_at_point_kernel(float const *normal_x, float const *normal_y, float const *offset, Vector2 point, float *out, std::size_t count) {
+	F x = F::broadcast(point.x);
+	F y = F::broadcast(point.y);
+	map_lanes<F>(out, count, [&](F nx, F ny, F offset) { return nx*x + ny*y - offset; }, normal_x, normal_y, offset);
+}
+
+template <class F>
+static void circles_at_point_kernel(float const *center_x, float const *center_y, float const *radius, Vector2 point, float *out, std::size_t count) {
+	F x = F::broadcast(point.x);
+	F y = F::broadcast(point.y);
+	map_lanes<F>(out, count, [&](F cx, F cy, F radius) {
+		F dx = x - cx;
+		F dy = y - cy;
+		return sqrt(dx*dx + dy*dy) - radius;
+	}, center_x, center_y, radius);
+}
+
+template <class F>
+static void ellipse_fast_kernel(Ellipse ellipse, float const *xs, float const *ys, float *out, std::size_t count) {
+	map_lanes<F>(out, count, [&](F x, F y) { return fast_ellipse_distance(ellipse, x, y); }, xs, ys);
+}
+
+template <class F>
+static void ellipse_bound_kernel(Ellipse ellipse, float const *xs, float const *ys, float *out, std::size_t count) {
+	F cx = F::broadcast(ellipse.center.x);
+	F cy = F::broadcast(ellipse.center.y);
+	F rx = F::broadcast(ellipse.radius.x);
+	F ry = F::broadcast(ellipse.radius.y);
+	F min_radius = F::broadcast(std::min(ellipse.radius.x, ellipse.radius.y));
+	map_lanes<F>(out, count, [&](F x, F y) {
+		F ux = (x - cx) / rx;
+		F uy = (y - cy) / ry;
+		return (sqrt(ux*ux + uy*uy) - F::broadcast(1)) * min_radius;
+	}, xs, ys);
+}
+
+template <class F>
+static void min_kernel(float const *a, float const *b, float *out, std::size_t count) {
+	map_lanes<F>(out, count, [](F a, F b) { return min(a, b); }, a, b);
+}
+
+template <class F>
+static void max_kernel(float const *a, float const *b, float *out, std::size_t count) {
+	map_lanes<F>(out, count, [](F a, F b) { return max(a, b); }, a, b);
+}
+
+template <class F>
+static void neg_kernel(float const *a, float *out, std::size_t count) {
+	map_lanes<F>(out, count, [](F a) { return -a; }, a);
+}
+
+template <class F>
+static void max_neg_kernel(float const *a, float const *b, float *out, std::size_t count) {
+	map_lanes<F>(out, count, [](F a, F b) { return max(a, -b); }, a, b);
+}
+
+/*
+#define x(name, parameters, arguments)
+SDFD_ENUMERATE_KERNEL(x)
+#undef x
+*/
+#define SDFD_ENUMERATE_KERNEL(x) \
+	x(plane,  (Plane plane, float const *xs, float const *ys, float *out, std::size_t count),   (plane, xs, ys, out, count)) \
+	x(circle, (Circle circle, float const *xs, float const *ys, float *out, std::size_t count), (circle, xs, ys, out, count)) \
+	x(plane_fold,  (Plane plane, bool is_max, float const *xs, float const *ys, float const *a, float *out, std::size_t count),   (plane, is_max, xs, ys, a, out, count)) \
+	x(circle_fold, (Circle circle, bool is_max, float const *xs, float const *ys, float const *a, float *out, std::size_t count), (circle, is_max, xs, ys, a, out, count)) \
+	x(ellipse_fast,  (Ellipse ellipse, float const *xs, float const *ys, float *out, std::size_t count), (ellipse, xs, ys, out, count)) \
+	x(ellipse_bound, (Ellipse ellipse, float const *xs, float const *ys, float *out, std::size_t count), (ellipse, xs, ys, out, count)) \
+	x(planes_at_point,  (float const *normal_x, float const *normal_y, float const *offset, Vector2 point, float *out, std::size_t count), (normal_x, normal_y, offset, point, out, count)) \
+	x(circles_at_point, (float const *center_x, float const *center_y, float const *radius, Vector2 point, float *out, std::size_t count), (center_x, center_y, radius, point, out, count)) \
+	x(min,    (float const *a, float const *b, float *out, std::size_t count),                  (a, b, out, count)) \
+	x(max,    (float const *a, float const *b, float *out, std::size_t count),                  (a, b, out, count)) \
+	x(neg,    (float const *a, float *out, std::size_t count),                                  (a, out, count)) \
+	x(max_neg, (float const *a, float const *b, float *out, std::size_t count),                 (a, b, out, count)) \
+
+struct Kernels {
+	#define x(name, parameters, arguments) void (*name) parameters;
+	SDFD_ENUMERATE_KERNEL(x)
+	#undef x
+};
+
+#if !SDFD_SIMD_X86
+#define x(name, parameters, arguments) static void name##_kernel_x1 parameters { name##_kernel<F32x1> arguments; }
+SDFD_ENUMERATE_KERNEL(x)
+#undef x
+#else
+#define x(name, parameters, arguments) static void name##_kernel_x4 parameters { name##_kernel<F32x4> arguments; }
+SDFD_ENUMERATE_KERNEL(x)
+#undef x
+#define x(name, parameters, arguments) SDFD_TARGET_AVX2 SDFD_FLATTEN static void name##_kernel_x8 parameters { name##_kernel<F32x8> arguments; }
+SDFD_ENUMERATE_KERNEL(x)
+#undef x
+#define x(name, parameters, arguments) SDFD_TARGET_AVX512 SDFD_FLATTEN static void name##_kernel_x16 parameters { name##_kernel<F32x16> arguments; }
+SDFD_ENUMERATE_KERNEL(x)
+#undef x
+#endif
+
+static Kernels select_kernels() {
+#if SDFD_SIMD_X86
+	if (cpu_supports_avx512f()) {
+		#define x(name, parameters, arguments) .name = name##_kernel_x16,
+		return {SDFD_ENUMERATE_KERNEL(x)};
+		#undef x
+	}
+	if (cpu_supports_avx2()) {
+		#define x(name, parameters, arguments) .name = name##_kernel_x8,
+		return {SDFD_ENUMERATE_KERNEL(x)};
+		#undef x
+	}
+	#define x(name, parameters, arguments) .name = name##_kernel_x4,
+	return {SDFD_ENUMERATE_KERNEL(x)};
+	#undef x
+#else
+	#define x(name, parameters, arguments) .name = name##_kernel_x1,
+	return {SDFD_ENUMERATE_KERNEL(x)};
+	#undef x
+#endif
+}
+
+static Kernels const &get_kernels() {
+	static Kernels const kernels = select_kernels();
+	return kernels;
+}
+
+// Number of points processed at once by batch evaluators.
+// Every operation keeps its results for a whole chunk.
+static constexpr std::size_t batch_chunk_size = 256;
+
+// Precision is switched on once for all points.
+static void evaluate_ellipse_batch(Ellipse ellipse, EvalPrecision precision, float const *xs, float const *ys, float *out, std::size_t count) {
+	switch (precision) {
+		case EvalPrecision::exact: {
+			for (std::size_t i = 0; i < count; ++i) {
+				out[i] = distance(ellipse, {xs[i], ys[i]});
+			}
+			break;
+		}
+		case EvalPrecision::fast: {
+			get_kernels().ellipse_fast(ellipse, xs, ys, out, count);
+			break;
+		}
+		case EvalPrecision::bound: {
+			get_kernels().ellipse_bound(ellipse, xs, ys, out, count);
+			break;
+		}
+		default:
+			assert(!"invalid EvalPrecision");
+	}
+}
+
+void evaluate_batch(Scene const &scene, Primitive const &primitive, std::span<float const> xs, std::span<float const> ys, std::span<float> out, EvalPrecision precision) {
+	assert(xs.size() == ys.size());
+	assert(out.size() >= xs.size());
+
+	std::size_t count = xs.size();
+
+	switch (primitive.kind) {
+		case Primitive::Kind::float1: {
+			std::fill_n(out.data(), count, primitive.float1);
+			break;
+		}
+		case Primitive::Kind::plane: {
+			get_kernels().plane(scale_plane(primitive.plane, scene.scale), xs.data(), ys.data(), out.data(), count);
+			break;
+		}
+		case Primitive::Kind::circle: {
+			Ellipse ellipse = {.center = scene.scale * primitive.circle.center, .radius = scene.scale * primitive.circle.radius};
+			if (ellipse.radius.x == ellipse.radius.y) {
+				// distance(Ellipse) does the same in this case.
+				get_kernels().circle(Circle{ellipse.center, ellipse.radius.x}, xs.data(), ys.data(), out.data(), count);
+				break;
+			}
+			evaluate_ellipse_batch(ellipse, precision, xs.data(), ys.data(), out.data(), count);
+			break;
+		}
+		default:
+			assert(!"invalid Primitive::Kind");
+	}
+}
+
+// Rows of batch scratch take at most this many floats, unless an object is so
+// big that chunks would get smaller than batch_min_chunk_size.
+static constexpr std::size_t batch_scratch_budget = 1 << 20;
+static constexpr std::size_t batch_min_chunk_size = 16;
+
+// Storage for evaluating an object over chunks of points, points into EvalContext::batch_rows.
+// Holds a row of NaNs for references to invalid operations, then a row for every
+// primitive and every operation.
+struct BatchScratch {
+	float *rows;
+	std::size_t chunk_size;
+	std::size_t primitive_count;
+
+	float *nan_row() { return rows; }
+	float *primitive_row(std::size_t index) { return rows + (1 + index) * chunk_size; }
+	float *operation_row(std::size_t index) { return rows + (1 + primitive_count + index) * chunk_size; }
+};
+
+static BatchScratch prepare_batch_scratch(EvalContext &context, Object const &object) {
+	std::size_t row_count = 1 + object.primitives.size() + object.operations.size();
+	std::size_t chunk_size = std::clamp(batch_scratch_budget / row_count, batch_min_chunk_size, batch_chunk_size);
+	if (context.batch_rows.size() < row_count * chunk_size) {
+		context.batch_rows.resize(row_count * chunk_size);
+	}
+	std::fill_n(context.batch_rows.data(), chunk_size, std::numeric_limits<float>::quiet_NaN());
+	return {
+		.rows = context.batch_rows.data(),
+		.chunk_size = chunk_size,
+		.primitive_count = object.primitives.size(),
+	};
+}
+
+static void evaluate_batch_chunk(EvalContext &context, Scene const &scene, Object const &object, float const *xs, float const *ys, float *out, std::size_t count, BatchScratch &scratch, EvalPrecision precision) {
+	if (object.operations.size() == 0) {
+		if (object.primitives.size() == 0) {
+			std::fill_n(out, count, std::numeric_limits<float>::infinity());
+			return;
+		}
+
+		evaluate_batch(scene, object.primitives.back(), {xs, count}, {ys, count}, {out, count}, precision);
+		return;
+	}
+
+	uint32_t generation = next_generation(context, object.primitives.size());
+	uint32_t *primitive_generations = context.primitive_generations.data();
+
+	for (std::size_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		auto &operation = object.operations[operation_index];
+
+		// Nothing can reference the last operation, so it is written straight to the output.
+		float *result = operation_index == object.operations.size() - 1 ? out : scratch.operation_row(operation_index);
+
+		auto evaluate_argument = [&](ArgumentIndex index) -> float const * {
+			switch (index.kind) {
+				default:
+				case ArgumentIndex::Kind::object_primitive: {
+					float *row = scratch.primitive_row(index.value);
+					if (primitive_generations[index.value] != generation) {
+						evaluate_batch(scene, object.primitives[index.value], {xs, count}, {ys, count}, {row, count}, precision);
+						primitive_generations[index.value] = generation;
+					}
+					return row;
+				}
+				case ArgumentIndex::Kind::object_operation: {
+					if (index.value >= operation_index)
+						return scratch.nan_row();
+					return scratch.operation_row(index.value);
+				}
+			}
+		};
+
+		auto evaluate_min = [&] { get_kernels().min(evaluate_argument(operation.args[0]), evaluate_argument(operation.args[1]), result, count); };
+		auto evaluate_max = [&] { get_kernels().max(evaluate_argument(operation.args[0]), evaluate_argument(operation.args[1]), result, count); };
+		auto evaluate_neg = [&] { get_kernels().neg(evaluate_argument(operation.args[0]), result, count); };
+		auto evaluate_range = [&](auto kernel) {
+			if (!is_valid_range(operation)) {
+				std::fill_n(result, count, std::numeric_limits<float>::quiet_NaN());
+				return;
+			}
+			memcpy(result, evaluate_argument(operation.args[0]), count * sizeof(float));
+			for (uint32_t value = operation.args[0].value + 1; value <= operation.args[1].value; ++value) {
+				kernel(result, evaluate_argument({.kind = operation.args[0].kind, .value = value}), result, count);
+			}
+		};
+		auto evaluate_min_range = [&] { evaluate_range(get_kernels().min); };
+		auto evaluate_max_range = [&] { evaluate_range(get_kernels().max); };
+		auto evaluate_max_neg = [&] { get_kernels().max_neg(evaluate_argument(operation.args[0]), evaluate_argument(operation.args[1]), result, count); };
+
+		switch (operation.kind) {
+			#define x(name, value, arity) case Operation::Kind::name: evaluate_##name(); break;
+			SDFD_ENUMERATE_OPERATION(x)
+			#undef x
+
+			default:
+				assert(!"invalid Operation::Kind");
+		}
+	}
+}
+
+void evaluate_batch(Scene const &scene, Object const &object, std::span<Vector2 const> points, std::span<float> out, EvalPrecision precision) {
+	evaluate_batch(get_thread_context(), scene, object, points, out, precision);
+}
+
+void evaluate_batch(EvalContext &context, Scene const &scene, Object const &object, std::span<Vector2 const> points, std::span<float> out, EvalPrecision precision) {
+	assert(out.size() >= points.size());
+
+	BatchScratch scratch = prepare_batch_scratch(context, object);
+
+	float xs[batch_chunk_size];
+	float ys[batch_chunk_size];
+
+	for (std::size_t start = 0; start < points.size(); start += scratch.chunk_size) {
+		std::size_t count = std::min(scratch.chunk_size, points.size() - start);
+		for (std::size_t i = 0; i < count; ++i) {
+			xs[i] = points[start + i].x;
+			ys[i] = points[start + i].y;
+		}
+		evaluate_batch_chunk(context, scene, object, xs, ys, out.data() + start, count, scratch, precision);
+	}
+}
+
+void evaluate_batch(Scene const &scene, Object const &object, std::span<float const> xs, std::span<float const> ys, std::span<float> out, EvalPrecision precision) {
+	evaluate_batch(get_thread_context(), scene, object, xs, ys, out, precision);
+}
+
+void evaluate_batch(EvalContext &context, Scene const &scene, Object const &object, std::span<float const> xs, std::span<float const> ys, std::span<float> out, EvalPrecision precision) {
+	assert(xs.size() == ys.size());
+	assert(out.size() >= xs.size());
+
+	BatchScratch scratch = prepare_batch_scratch(context, object);
+
+	for (std::size_t start = 0; start < xs.size(); start += scratch.chunk_size) {
+		std::size_t count = std::min(scratch.chunk_size, xs.size() - start);
+		evaluate_batch_chunk(context, scene, object, xs.data() + start, ys.data() + start, out.data() + start, count, scratch, precision);
+	}
+}
+
+// Distances from point to the nearest and the farthest points of rect.
+static Interval distance_range(Rect rect, Vector2 point) {
+	Vector2 nearest = {
+		std::clamp(point.x, rect.min.x, rect.max.x),
+		std::clamp(point.y, rect.min.y, rect.max.y),
+	};
+	Vector2 farthest = {
+		point.x < (rect.min.x + rect.max.x) * 0.5f ? rect.max.x : rect.min.x,
+		point.y < (rect.min.y + rect.max.y) * 0.5f ? rect.max.y : rect.min.y,
+	};
+	return {length(nearest - point), length(farthest - point)};
+}
+
+static Interval get_interval(Plane plane, Rect rect) {
+	// Linear, so extremes are in the corners.
+	Vector2 low  = {plane.normal.x > 0 ? rect.min.x : rect.max.x, plane.normal.y > 0 ? rect.min.y : rect.max.y};
+	Vector2 high = {plane.normal.x > 0 ? rect.max.x : rect.min.x, plane.normal.y > 0 ? rect.max.y : rect.min.y};
+	return {dot(plane.normal, low) - plane.offset, dot(plane.normal, high) - plane.offset};
+}
+
+static Interval get_interval(Circle circle, Rect rect) {
+	Interval range = distance_range(rect, circle.center);
+	return {range.min - circle.radius, range.max - circle.radius};
+}
+
+static Interval get_interval(Ellipse ellipse, Rect rect, EvalPrecision precision) {
+	if (precision == EvalPrecision::bound) {
+		// distance_bound only depends on the distance from the center in space
+		// scaled by 1 / radius, where rect is still a rect.
+		Rect scaled = {(rect.min - ellipse.center) / ellipse.radius, (rect.max - ellipse.center) / ellipse.radius};
+		Interval range = distance_range(scaled, {0, 0});
+		float min_radius = std::min(ellipse.radius.x, ellipse.radius.y);
+		return {(range.min - 1) * min_radius, (range.max - 1) * min_radius};
+	}
+
+	// Ellipse is between circles with its smallest and largest radii, so
+	// its distance is between distances to them.
+	Interval range = distance_range(rect, ellipse.center);
+	Interval result = {
+		range.min - std::max(ellipse.radius.x, ellipse.radius.y),
+		range.max - std::min(ellipse.radius.x, ellipse.radius.y),
+	};
+
+	// Distance changes no faster than the point moves.
+	Vector2 center = (rect.min + rect.max) * 0.5f;
+	float center_distance = distance(ellipse, center);
+	float half_diagonal = length(rect.max - rect.min) * 0.5f;
+	result.min = std::max(result.min, center_distance - half_diagonal);
+	result.max = std::min(result.max, center_distance + half_diagonal);
+	return result;
+}
+
+Interval evaluate_interval(Scene const &scene, Primitive const &primitive, Rect rect, EvalPrecision precision) {
+	switch (primitive.kind) {
+		case Primitive::Kind::float1: {
+			return {primitive.float1, primitive.float1};
+		}
+		case Primitive::Kind::plane: {
+			return get_interval(scale_plane(primitive.plane, scene.scale), rect);
+		}
+		case Primitive::Kind::circle: {
+			Ellipse ellipse = {.center = scene.scale * primitive.circle.center, .radius = scene.scale * primitive.circle.radius};
+			if (ellipse.radius.x == ellipse.radius.y) {
+				return get_interval(Circle{ellipse.center, ellipse.radius.x}, rect);
+			}
+			return get_interval(ellipse, rect, precision);
+		}
+		default:
+			assert(!"invalid Primitive::Kind");
+			return {};
+	}
+}
+
+Interval evaluate_interval(Scene const &scene, Object const &object, Rect rect, EvalPrecision precision) {
+	return evaluate_interval(get_thread_context(), scene, object, rect, precision);
+}
+
+Interval evaluate_interval(EvalContext &context, Scene const &scene, Object const &object, Rect rect, EvalPrecision precision) {
+	if (object.operations.size() == 0) {
+		if (object.primitives.size() == 0) {
+			return {std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
+		}
+
+		return evaluate_interval(scene, object.primitives.back(), rect, precision);
+	}
+
+	if (context.operation_intervals.size() < object.operations.size()) {
+		context.operation_intervals.resize(object.operations.size());
+	}
+	Interval *operation_intervals = context.operation_intervals.data();
+
+	std::size_t operation_index = 0;
+
+	// Operations are made of min, max and neg, which are monotonic, so applying
+	// them to the ends of intervals gives the ends of the result. NaNs from
+	// invalid references propagate the same way as in evaluate.
+	auto evaluate_argument = [&](ArgumentIndex index) -> Interval {
+		switch (index.kind) {
+			default:
+			case ArgumentIndex::Kind::object_primitive: {
+				return evaluate_interval(scene, object.primitives[index.value], rect, precision);
+			}
+			case ArgumentIndex::Kind::object_operation: {
+				if (index.value >= operation_index)
+					return {std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN()};
+				return operation_intervals[index.value];
+			}
+		}
+	};
+
+	for (; operation_index < object.operations.size(); ++operation_index) {
+		auto &operation = object.operations[operation_index];
+
+		auto evaluate_min = [&] {
+			Interval a = evaluate_argument(operation.args[0]);
+			Interval b = evaluate_argument(operation.args[1]);
+			return Interval{std::min(a.min, b.min), std::min(a.max, b.max)};
+		};
+		auto evaluate_max = [&] {
+			Interval a = evaluate_argument(operation.args[0]);
+			Interval b = evaluate_argument(operation.args[1]);
+			return Interval{std::max(a.min, b.min), std::max(a.max, b.max)};
+		};
+		auto evaluate_neg = [&] {
+			Interval a = evaluate_argument(operation.args[0]);
+			return Interval{-a.max, -a.min};
+		};
+		auto evaluate_range = [&](auto fold) {
+			if (!is_valid_range(operation))
+				return Interval{std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN()};
+			Interval result = evaluate_argument(operation.args[0]);
+			for (uint32_t value = operation.args[0].value + 1; value <= operation.args[1].value; ++value) {
+				Interval b = evaluate_argument({.kind = operation.args[0].kind, .value = value});
+				result = {fold(result.min, b.min), fold(result.max, b.max)};
+			}
+			return result;
+		};
+		auto evaluate_min_range = [&] { return evaluate_range([](float a, float b) { return std::min(a, b); }); };
+		auto evaluate_max_range = [&] { return evaluate_range([](float a, float b) { return std::max(a, b); }); };
+		auto evaluate_max_neg = [&] {
+			Interval a = evaluate_argument(operation.args[0]);
+			Interval b = evaluate_argument(operation.args[1]);
+			return Interval{std::max(a.min, -b.max), std::max(a.max, -b.min)};
+		};
+
+		switch (operation.kind) {
+			#define x(name, value, arity) case Operation::Kind::name: operation_intervals[operation_index] = evaluate_##name(); break;
+			SDFD_ENUMERATE_OPERATION(x)
+			#undef x
+
+			default:
+				assert(!"invalid Operation::Kind");
+		}
+	}
+	return operation_intervals[object.operations.size() - 1];
+}
+
+static constexpr Rect everywhere = {{-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()}, {std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()}};
+static constexpr Rect nowhere = {{std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()}, {-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()}};
+
+static constexpr Rect unknown = {{std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN()}, {std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN()}};
+
+static bool is_unknown(Rect rect) {
+	return rect.min.x != rect.min.x;
+}
+
+static Rect unite(Rect a, Rect b) {
+	if (is_unknown(a) || is_unknown(b))
+		return unknown;
+	return {{std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y)}, {std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y)}};
+}
+
+// Not made empty when a and b don't overlap, so that distance to the result
+// is still the larger of distances to a and b along each axis.
+static Rect intersect(Rect a, Rect b) {
+	if (is_unknown(a) || is_unknown(b))
+		return unknown;
+	return {{std::max(a.min.x, b.min.x), std::max(a.min.y, b.min.y)}, {std::min(a.max.x, b.max.x), std::min(a.max.y, b.max.y)}};
+}
+
+// Larger of distances from rect to bounds along x and y, zero when they overlap
+// or bounds are unknown.
+static float get_gap(Rect rect, Rect bounds) {
+	if (is_unknown(bounds))
+		return 0;
+	float x = std::max({bounds.min.x - rect.max.x, rect.min.x - bounds.max.x, 0.0f});
+	float y = std::max({bounds.min.y - rect.max.y, rect.min.y - bounds.max.y, 0.0f});
+	return std::max(x, y);
+}
+
+// True for unknown bounds.
+static bool contains(Rect rect, Vector2 point) {
+	return !(point.x < rect.min.x || point.x > rect.max.x || point.y < rect.min.y || point.y > rect.max.y);
+}
+
+Rect get_bounds(Scene const &scene, Primitive const &primitive) {
+	switch (primitive.kind) {
+		case Primitive::Kind::float1: {
+			if (isnan(primitive.float1))
+				return unknown;
+			// Only infinity is never inside and never closer than its bounds.
+			return primitive.float1 == std::numeric_limits<float>::infinity() ? nowhere : everywhere;
+		}
+		case Primitive::Kind::plane: {
+			// Distance to a plane along an axis is the distance along that axis.
+			Plane plane = scale_plane(primitive.plane, scene.scale);
+			if (!isfinite(plane.normal.x) || !isfinite(plane.normal.y) || !isfinite(plane.offset))
+				return unknown;
+			Rect result = everywhere;
+			if (plane.normal.y == 0) {
+				if (plane.normal.x == 1) {
+					result.max.x = plane.offset;
+				} else if (plane.normal.x == -1) {
+					result.min.x = -plane.offset;
+				}
+			} else if (plane.normal.x == 0) {
+				if (plane.normal.y == 1) {
+					result.max.y = plane.offset;
+				} else if (plane.normal.y == -1) {
+					result.min.y = -plane.offset;
+				}
+			}
+			return result;
+		}
+		case Primitive::Kind::circle: {
+			Vector2 center = scene.scale * primitive.circle.center;
+			Vector2 radius = abs(scene.scale * primitive.circle.radius);
+			if (!isfinite(center.x) || !isfinite(center.y) || !isfinite(radius.x) || !isfinite(radius.y))
+				return unknown;
+			return {center - radius, center + radius};
+		}
+		default:
+			assert(!"invalid Primitive::Kind");
+			return everywhere;
+	}
+}
+
+Rect get_bounds(Scene const &scene, Object const &object) {
+	return get_bounds(get_thread_context(), scene, object);
+}
+
+Rect get_bounds(EvalContext &context, Scene const &scene, Object const &object) {
+	if (object.operations.size() == 0) {
+		if (object.primitives.size() == 0) {
+			return nowhere;
+		}
+
+		return get_bounds(scene, object.primitives.back());
+	}
+
+	if (context.operation_bounds.size() < object.operations.size()) {
+		context.operation_bounds.resize(object.operations.size());
+	}
+	Rect *operation_bounds = context.operation_bounds.data();
+
+	auto get_argument = [&](ArgumentIndex index, std::size_t operation_index) -> Rect {
+		switch (index.kind) {
+			default:
+			case ArgumentIndex::Kind::object_primitive: {
+				return get_bounds(scene, object.primitives[index.value]);
+			}
+			case ArgumentIndex::Kind::object_operation: {
+				if (index.value >= operation_index)
+					return unknown;
+				return operation_bounds[index.value];
+			}
+		}
+	};
+
+	for (std::size_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		auto &operation = object.operations[operation_index];
+		Rect result = everywhere;
+		switch (operation.kind) {
+			case Operation::Kind::min: {
+				result = unite(get_argument(operation.args[0], operation_index), get_argument(operation.args[1], operation_index));
+				break;
+			}
+			case Operation::Kind::max: {
+				result = intersect(get_argument(operation.args[0], operation_index), get_argument(operation.args[1], operation_index));
+				break;
+			}
+			case Operation::Kind::neg: {
+				if (is_unknown(get_argument(operation.args[0], operation_index))) {
+					result = unknown;
+				}
+				break;
+			}
+			case Operation::Kind::min_range:
+			case Operation::Kind::max_range: {
+				if (!is_valid_range(operation)) {
+					result = unknown;
+					break;
+				}
+				auto fold = operation.kind == Operation::Kind::min_range ? unite : intersect;
+				result = operation.kind == Operation::Kind::min_range ? nowhere : everywhere;
+				for_each_argument(operation, [&](ArgumentIndex index) {
+					result = fold(result, get_argument(index, operation_index));
+				});
+				break;
+			}
+			case Operation::Kind::max_neg: {
+				// Negated argument is unbounded.
+				result = intersect(get_argument(operation.args[0], operation_index), is_unknown(get_argument(operation.args[1], operation_index)) ? unknown : everywhere);
+				break;
+			}
+			default:
+				assert(!"invalid Operation::Kind");
+		}
+		operation_bounds[operation_index] = result;
+	}
+	return operation_bounds[object.operations.size() - 1];
+}
+
+struct PrimitiveHash {
+	std::size_t operator()(Primitive const &primitive) const {
+		uint32_t bits[3] = {};
+		switch (primitive.kind) {
+			#define x(type, name, value) case Primitive::Kind::name: memcpy(bits, &primitive.name, sizeof(type)); break;
+			SDFD_ENUMERATE_PRIMITIVE(x)
+			#undef x
+		}
+		std::size_t hash = (std::size_t)primitive.kind;
+		for (uint32_t b : bits) {
+			hash = hash * 0x9E3779B97F4A7C15ull + b;
+		}
+		return hash;
+	}
+};
+
+// Compares bits, so NaNs with the same bits are equal and 0 is different from -0.
+struct PrimitiveEqual {
+	bool operator()(Primitive const &a, Primitive const &b) const {
+		if (a.kind != b.kind)
+			return false;
+		switch (a.kind) {
+			#define x(type, name, value) case Primitive::Kind::name: return memcmp(&a.name, &b.name, sizeof(type)) == 0;
+			SDFD_ENUMERATE_PRIMITIVE(x)
+			#undef x
+		}
+		return false;
+	}
+};
+
+// Only arguments up to operation's arity are considered.
+struct OperationHash {
+	std::size_t operator()(Operation const &operation) const {
+		std::size_t hash = (std::size_t)operation.kind;
+		for (uint32_t i = 0; i < get_arity(operation.kind); ++i) {
+			hash = hash * 0x9E3779B97F4A7C15ull + operation.args[i].kind;
+			hash = hash * 0x9E3779B97F4A7C15ull + operation.args[i].value;
+		}
+		return hash;
+	}
+};
+
+struct OperationEqual {
+	bool operator()(Operation const &a, Operation const &b) const {
+		if (a.kind != b.kind)
+			return false;
+		for (uint32_t i = 0; i < get_arity(a.kind); ++i) {
+			if (a.args[i].kind != b.args[i].kind || a.args[i].value != b.args[i].value)
+				return false;
+		}
+		return true;
+	}
+};
+
+// Rewrites min_range and max_range into chains of min and max folded the same
+// way, so that passes can change their arguments one by one.
+static void split_ranges(Object &object) {
+	bool has_ranges = false;
+	for (auto &operation : object.operations) {
+		has_ranges |= is_range(operation.kind);
+	}
+	if (!has_ranges)
+		return;
+
+	std::vector<uint32_t> operation_map(object.operations.size());
+	std::vector<Operation> operations;
+
+	for (uint32_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		Operation operation = object.operations[operation_index];
+
+		// Keep invalid references invalid after operations move.
+		auto map = [&](ArgumentIndex index) {
+			if (index.kind == ArgumentIndex::Kind::object_operation) {
+				index.value = index.value < operation_index ? operation_map[index.value] : 0x7fffffff;
+			}
+			return index;
+		};
+
+		if (is_range(operation.kind)) {
+			Operation::Kind kind = operation.kind == Operation::Kind::min_range ? Operation::Kind::min : Operation::Kind::max;
+			if (!is_valid_range(operation)) {
+				ArgumentIndex nan = object_operation_index(0x7fffffff);
+				operations.push_back({kind, {nan, nan}});
+			} else if (operation.args[0].value == operation.args[1].value) {
+				// min and max of the same argument are that argument.
+				ArgumentIndex index = map(operation.args[0]);
+				operations.push_back({kind, {index, index}});
+			} else {
+				ArgumentIndex folded = map(operation.args[0]);
+				for (uint32_t value = operation.args[0].value + 1; value <= operation.args[1].value; ++value) {
+					operations.push_back({kind, {folded, map({.kind = operation.args[0].kind, .value = value})}});
+					folded = object_operation_index(operations.size() - 1);
+				}
+			}
+		} else {
+			for (uint32_t i = 0; i < get_arity(operation.kind); ++i) {
+				operation.args[i] = map(operation.args[i]);
+			}
+			operations.push_back(operation);
+		}
+
+		operation_map[operation_index] = operations.size() - 1;
+	}
+
+	object.operations = std::move(operations);
+}
+
+void deduplicate(Object &object) {
+	// Without operations only the last primitive matters.
+	if (object.operations.size() == 0)
+		return;
+
+	// Merged primitives and operations would no longer be next to each other.
+	split_ranges(object);
+
+	std::vector<uint32_t> primitive_map(object.primitives.size());
+	std::vector<Primitive> primitives;
+	std::unordered_map<Primitive, uint32_t, PrimitiveHash, PrimitiveEqual> primitive_indices;
+
+	for (uint32_t primitive_index = 0; primitive_index < object.primitives.size(); ++primitive_index) {
+		auto &primitive = object.primitives[primitive_index];
+		auto [it, inserted] = primitive_indices.try_emplace(primitive, (uint32_t)primitives.size());
+		if (inserted) {
+			primitives.push_back(primitive);
+		}
+		primitive_map[primitive_index] = it->second;
+	}
+
+	std::vector<uint32_t> operation_map(object.operations.size());
+	std::vector<Operation> operations;
+	std::unordered_map<Operation, uint32_t, OperationHash, OperationEqual> operation_indices;
+
+	for (uint32_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		Operation operation = object.operations[operation_index];
+		for (uint32_t i = 0; i < get_arity(operation.kind); ++i) {
+			ArgumentIndex &index = operation.args[i];
+			switch (index.kind) {
+				default:
+				case ArgumentIndex::Kind::object_primitive: {
+					index.value = primitive_map[index.value];
+					break;
+				}
+				case ArgumentIndex::Kind::object_operation: {
+					// Keep invalid references invalid after operations move.
+					index.value = index.value < operation_index ? operation_map[index.value] : 0x7fffffff;
+					break;
+				}
+			}
+		}
+
+		auto [it, inserted] = operation_indices.try_emplace(operation, (uint32_t)operations.size());
+		if (inserted) {
+			operations.push_back(operation);
+		}
+		operation_map[operation_index] = it->second;
+	}
+
+	// If the last operation was merged, everything after its copy is not needed.
+	operations.resize(operation_map.back() + 1);
+
+	object.primitives = std::move(primitives);
+	object.operations = std::move(operations);
+}
+
+// Applies operation to constant arguments.
+static float fold(Operation::Kind kind, float const *args) {
+	switch (kind) {
+		case Operation::Kind::min: return std::min(args[0], args[1]);
+		case Operation::Kind::max: return std::max(args[0], args[1]);
+		case Operation::Kind::neg: return -args[0];
+		case Operation::Kind::max_neg: return std::max(args[0], -args[1]);
+		default:
+			assert(!"invalid Operation::Kind");
+			return 0;
+	}
+}
+
+void optimize(Object &object) {
+	if (object.operations.size() == 0) {
+		// Only the last primitive matters.
+		if (object.primitives.size() > 1) {
+			object.primitives.erase(object.primitives.begin(), object.primitives.end() - 1);
+		}
+		return;
+	}
+
+	split_ranges(object);
+
+	// Simplified operations are added to a new object, which starts with all
+	// original primitives. Folded constants are added after them.
+	Object simplified;
+	simplified.primitives = object.primitives;
+
+	auto add_constant = [&](float value) {
+		simplified.primitives.push_back(Primitive(value));
+		return object_primitive_index(simplified.primitives.size() - 1);
+	};
+
+	auto is_constant = [&](ArgumentIndex index) {
+		return index.kind == ArgumentIndex::Kind::object_primitive && simplified.primitives[index.value].kind == Primitive::Kind::float1;
+	};
+
+	auto same = [](ArgumentIndex a, ArgumentIndex b) {
+		return a.kind == b.kind && a.value == b.value;
+	};
+
+	// What each operation was replaced with, referencing the simplified object.
+	std::vector<ArgumentIndex> replacements(object.operations.size());
+
+	for (uint32_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		Operation operation = object.operations[operation_index];
+		uint32_t arity = get_arity(operation.kind);
+
+		bool all_constant = true;
+		float constants[2] = {};
+
+		for (uint32_t i = 0; i < arity; ++i) {
+			ArgumentIndex &index = operation.args[i];
+			if (index.kind == ArgumentIndex::Kind::object_operation) {
+				index = index.value < operation_index ? replacements[index.value] : add_constant(std::numeric_limits<float>::quiet_NaN());
+			}
+			if (is_constant(index)) {
+				constants[i] = simplified.primitives[index.value].float1;
+			} else {
+				all_constant = false;
+			}
+		}
+
+		ArgumentIndex &replacement = replacements[operation_index];
+
+		if (all_constant) {
+			replacement = add_constant(fold(operation.kind, constants));
+		} else if (operation.kind == Operation::Kind::neg && operation.args[0].kind == ArgumentIndex::Kind::object_operation && simplified.operations[operation.args[0].value].kind == Operation::Kind::neg) {
+			replacement = simplified.operations[operation.args[0].value].args[0];
+		} else if ((operation.kind == Operation::Kind::min || operation.kind == Operation::Kind::max) && same(operation.args[0], operation.args[1])) {
+			replacement = operation.args[0];
+		} else {
+			simplified.operations.push_back(operation);
+			replacement = object_operation_index(simplified.operations.size() - 1);
+		}
+	}
+
+	ArgumentIndex root = replacements.back();
+
+	object = {};
+
+	if (root.kind == ArgumentIndex::Kind::object_primitive) {
+		object.primitives.push_back(simplified.primitives[root.value]);
+		return;
+	}
+
+	// Operations reference only previous ones, so walking backwards from the
+	// root finds everything it depends on.
+	std::vector<bool> primitive_used(simplified.primitives.size());
+	std::vector<bool> operation_used(root.value + 1);
+	operation_used[root.value] = true;
+
+	for (uint32_t operation_index = root.value + 1; operation_index--;) {
+		if (!operation_used[operation_index])
+			continue;
+		auto &operation = simplified.operations[operation_index];
+		for (uint32_t i = 0; i < get_arity(operation.kind); ++i) {
+			ArgumentIndex index = operation.args[i];
+			if (index.kind == ArgumentIndex::Kind::object_primitive) {
+				primitive_used[index.value] = true;
+			} else {
+				operation_used[index.value] = true;
+			}
+		}
+	}
+
+	std::vector<uint32_t> primitive_map(simplified.primitives.size());
+	for (uint32_t primitive_index = 0; primitive_index < simplified.primitives.size(); ++primitive_index) {
+		if (primitive_used[primitive_index]) {
+			primitive_map[primitive_index] = object.primitives.size();
+			object.primitives.push_back(simplified.primitives[primitive_index]);
+		}
+	}
+
+	std::vector<uint32_t> operation_map(root.value + 1);
+	for (uint32_t operation_index = 0; operation_index <= root.value; ++operation_index) {
+		if (!operation_used[operation_index])
+			continue;
+
+		Operation operation = simplified.operations[operation_index];
+		for (uint32_t i = 0; i < get_arity(operation.kind); ++i) {
+			ArgumentIndex &index = operation.args[i];
+			if (index.kind == ArgumentIndex::Kind::object_primitive) {
+				index.value = primitive_map[index.value];
+			} else {
+				index.value = operation_map[index.value];
+			}
+		}
+
+		operation_map[operation_index] = object.operations.size();
+		object.operations.push_back(operation);
+	}
+
+	deduplicate(object);
+	fuse(object);
+}
+
+void fuse(Object &object) {
+	if (object.operations.size() == 0)
+		return;
+
+	split_ranges(object);
+
+	// Primitives are renumbered in order of first use, unused ones go last.
+	constexpr uint32_t unused = ~0u;
+	std::vector<uint32_t> primitive_map(object.primitives.size(), unused);
+	std::vector<Primitive> primitives;
+	auto use_primitive = [&](uint32_t primitive_index) {
+		if (primitive_map[primitive_index] == unused) {
+			primitive_map[primitive_index] = primitives.size();
+			primitives.push_back(object.primitives[primitive_index]);
+		}
+	};
+	for (auto &operation : object.operations) {
+		for (uint32_t i = 0; i < get_arity(operation.kind); ++i) {
+			if (operation.args[i].kind == ArgumentIndex::Kind::object_primitive) {
+				use_primitive(operation.args[i].value);
+			}
+		}
+	}
+	for (uint32_t primitive_index = 0; primitive_index < object.primitives.size(); ++primitive_index) {
+		use_primitive(primitive_index);
+	}
+	object.primitives = std::move(primitives);
+
+	std::vector<uint32_t> use_counts(object.operations.size());
+	for (uint32_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		auto &operation = object.operations[operation_index];
+		for (uint32_t i = 0; i < get_arity(operation.kind); ++i) {
+			ArgumentIndex &index = operation.args[i];
+			if (index.kind == ArgumentIndex::Kind::object_primitive) {
+				index.value = primitive_map[index.value];
+			} else if (index.value < operation_index) {
+				++use_counts[index.value];
+			}
+		}
+	}
+
+	// A chain is extended in place: when the only user of a min or max of
+	// consecutive primitives adds the next one, the chain takes its place.
+	std::vector<uint32_t> operation_map(object.operations.size());
+	std::vector<Operation> operations;
+
+	// Index of the original operation whose value each new one holds.
+	std::vector<uint32_t> origins;
+
+	for (uint32_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		Operation operation = object.operations[operation_index];
+		for (uint32_t i = 0; i < get_arity(operation.kind); ++i) {
+			ArgumentIndex &index = operation.args[i];
+			if (index.kind == ArgumentIndex::Kind::object_operation) {
+				index.value = index.value < operation_index ? operation_map[index.value] : 0x7fffffff;
+			}
+		}
+
+		auto get_single_use = [&](ArgumentIndex index) -> Operation * {
+			if (index.kind != ArgumentIndex::Kind::object_operation || index.value >= operations.size())
+				return nullptr;
+			if (use_counts[origins[index.value]] != 1)
+				return nullptr;
+			return &operations[index.value];
+		};
+
+		bool is_min_or_max = operation.kind == Operation::Kind::min || operation.kind == Operation::Kind::max;
+		if (is_min_or_max && operation.args[1].kind == ArgumentIndex::Kind::object_primitive) {
+			Operation::Kind range_kind = operation.kind == Operation::Kind::min ? Operation::Kind::min_range : Operation::Kind::max_range;
+			Operation *chain = get_single_use(operation.args[0]);
+			bool extends = chain
+				&& chain->args[0].kind == ArgumentIndex::Kind::object_primitive
+				&& chain->args[1].kind == ArgumentIndex::Kind::object_primitive
+				&& (chain->kind == range_kind || (chain->kind == operation.kind && chain->args[0].value + 1 == chain->args[1].value))
+				&& chain->args[1].value + 1 == operation.args[1].value;
+			if (extends) {
+				chain->kind = range_kind;
+				chain->args[1] = operation.args[1];
+				origins[operation.args[0].value] = operation_index;
+				operation_map[operation_index] = operation.args[0].value;
+				continue;
+			}
+		}
+
+		if (operation.kind == Operation::Kind::max) {
+			Operation *negation = get_single_use(operation.args[1]);
+			if (negation && negation->kind == Operation::Kind::neg) {
+				operation.kind = Operation::Kind::max_neg;
+				operation.args[1] = negation->args[0];
+			}
+		}
+
+		operation_map[operation_index] = operations.size();
+		operations.push_back(operation);
+		origins.push_back(operation_index);
+	}
+
+	// Negations merged into max_neg and operations after the extended chains
+	// that were merged into the last one are no longer used.
+	uint32_t root = operation_map.back();
+	std::vector<bool> operation_used(root + 1);
+	operation_used[root] = true;
+	for (uint32_t operation_index = root + 1; operation_index--;) {
+		if (!operation_used[operation_index])
+			continue;
+		for_each_argument(operations[operation_index], [&](ArgumentIndex index) {
+			if (index.kind == ArgumentIndex::Kind::object_operation && index.value < operation_index) {
+				operation_used[index.value] = true;
+			}
+		});
+	}
+
+	std::vector<uint32_t> used_map(root + 1);
+	object.operations.clear();
+	for (uint32_t operation_index = 0; operation_index <= root; ++operation_index) {
+		if (!operation_used[operation_index])
+			continue;
+
+		Operation operation = operations[operation_index];
+		for (uint32_t i = 0; i < get_arity(operation.kind); ++i) {
+			ArgumentIndex &index = operation.args[i];
+			if (index.kind == ArgumentIndex::Kind::object_operation && index.value < operation_index) {
+				index.value = used_map[index.value];
+			}
+		}
+
+		used_map[operation_index] = object.operations.size();
+		object.operations.push_back(operation);
+	}
+}
+
+// Unions with at least this many circles are compiled to a bounding volume hierarchy.
+// Below that, evaluating all of them in batches is faster than walking the tree.
+static constexpr uint32_t bvh_min_primitive_count = 256;
+
+// Specializing replaces the tree with the primitives near the rect when there are at most this many.
+static constexpr uint32_t bvh_max_expanded_count = 64;
+
+// Nodes with at most this many primitives are leaves. Circles of a leaf are
+// evaluated with one kernel call.
+static constexpr uint32_t bvh_leaf_size = 16;
+
+// Nodes are halved, so the tree is less than 32 levels deep and the stack
+// holds at most one waiting sibling per level.
+static constexpr uint32_t bvh_max_stack_size = 64;
+
+static std::shared_ptr<Program::Bvh const> build_bvh(std::vector<Ellipse> ellipses, bool is_circles) {
+	constexpr float infinity = std::numeric_limits<float>::infinity();
+
+	auto bvh = std::make_shared<Program::Bvh>();
+	bvh->is_circles = is_circles;
+	bvh->nodes.resize(1);
+
+	struct Task {
+		uint32_t node;
+		uint32_t first;
+		uint32_t count;
+	};
+	std::vector<Task> tasks = {{0, 0, (uint32_t)ellipses.size()}};
+	while (tasks.size()) {
+		Task task = tasks.back();
+		tasks.pop_back();
+
+		auto begin = ellipses.begin() + task.first;
+		auto end = begin + task.count;
+
+		Program::Bvh::Node node = {
+			.bounds = {{infinity, infinity}, {-infinity, -infinity}},
+			.min_ratio = 1,
+			.max_depth = 0,
+			.first = task.first,
+			.count = task.count,
+		};
+		Rect centers = node.bounds;
+		for (auto it = begin; it != end; ++it) {
+			float max_radius = std::max(it->radius.x, it->radius.y);
+			float min_radius = std::min(it->radius.x, it->radius.y);
+			node.bounds.min = {std::min(node.bounds.min.x, it->center.x - max_radius), std::min(node.bounds.min.y, it->center.y - max_radius)};
+			node.bounds.max = {std::max(node.bounds.max.x, it->center.x + max_radius), std::max(node.bounds.max.y, it->center.y + max_radius)};
+			node.min_ratio = std::min(node.min_ratio, min_radius / max_radius);
+			node.max_depth = std::max(node.max_depth, min_radius);
+			centers.min = {std::min(centers.min.x, it->center.x), std::min(centers.min.y, it->center.y)};
+			centers.max = {std::max(centers.max.x, it->center.x), std::max(centers.max.y, it->center.y)};
+		}
+
+		if (task.count > bvh_leaf_size) {
+			// Split in half across the longer side of centers.
+			bool split_x = centers.max.x - centers.min.x >= centers.max.y - centers.min.y;
+			uint32_t half = task.count / 2;
+			std::nth_element(begin, begin + half, end, [&](Ellipse const &a, Ellipse const &b) {
+				return split_x ? a.center.x < b.center.x : a.center.y < b.center.y;
+			});
+
+			node.first = bvh->nodes.size();
+			node.count = 0;
+			bvh->nodes.resize(bvh->nodes.size() + 2);
+			tasks.push_back({node.first, task.first, half});
+			tasks.push_back({node.first + 1, task.first + half, task.count - half});
+		}
+
+		bvh->nodes[task.node] = node;
+	}
+
+	auto &primitives = bvh->primitives;
+	for (auto &ellipse : ellipses) {
+		primitives.center_x.push_back(ellipse.center.x);
+		primitives.center_y.push_back(ellipse.center.y);
+		primitives.radius_x.push_back(ellipse.radius.x);
+		primitives.radius_y.push_back(ellipse.radius.y);
+	}
+	return bvh;
+}
+
+// Lowest value primitives of node can have in rect, see Program::Bvh::Node.
+static float get_lower_bound(Program::Bvh::Node const &node, Rect rect) {
+	Vector2 gap = {
+		std::max({node.bounds.min.x - rect.max.x, rect.min.x - node.bounds.max.x, 0.0f}),
+		std::max({node.bounds.min.y - rect.max.y, rect.min.y - node.bounds.max.y, 0.0f}),
+	};
+	float gap_length = length(gap);
+	return gap_length > 0 ? gap_length * node.min_ratio : -node.max_depth;
+}
+
+// Calls visit with the first primitive and primitive count of leaves whose
+// lower bound over rect is less than bound. Nearer children are visited first,
+// so that visit can lower bound early and more of the tree is skipped.
+template <class Visit>
+static void walk_bvh(Program::Bvh const &bvh, Rect rect, float const &bound, Visit &&visit) {
+	struct Entry {
+		uint32_t node;
+		float lower_bound;
+	};
+	Entry stack[bvh_max_stack_size];
+	uint32_t stack_size = 0;
+	stack[stack_size++] = {0, get_lower_bound(bvh.nodes[0], rect)};
+
+	while (stack_size) {
+		Entry entry = stack[--stack_size];
+		if (entry.lower_bound >= bound)
+			continue;
+
+		auto &node = bvh.nodes[entry.node];
+		if (node.count) {
+			visit(node.first, node.count);
+			continue;
+		}
+
+		Entry a = {node.first, get_lower_bound(bvh.nodes[node.first], rect)};
+		Entry b = {node.first + 1, get_lower_bound(bvh.nodes[node.first + 1], rect)};
+		if (a.lower_bound < b.lower_bound) {
+			std::swap(a, b);
+		}
+		assert(stack_size + 2 <= bvh_max_stack_size);
+		stack[stack_size++] = a;
+		stack[stack_size++] = b;
+	}
+}
+
+static Ellipse get_ellipse(Program::Bvh const &bvh, uint32_t index) {
+	auto &primitives = bvh.primitives;
+	return {{primitives.center_x[index], primitives.center_y[index]}, {primitives.radius_x[index], primitives.radius_y[index]}};
+}
+
+static float evaluate_bvh(Program::Bvh const &bvh, Vector2 point, EvalPrecision precision) {
+	auto &kernels = get_kernels();
+	auto &primitives = bvh.primitives;
+
+	float best = std::numeric_limits<float>::infinity();
+	walk_bvh(bvh, {point, point}, best, [&](uint32_t first, uint32_t count) {
+		float values[bvh_leaf_size];
+		if (bvh.is_circles) {
+			kernels.circles_at_point(primitives.center_x.data() + first, primitives.center_y.data() + first, primitives.radius_x.data() + first, point, values, count);
+		} else {
+			for (uint32_t i = 0; i < count; ++i) {
+				values[i] = distance(get_ellipse(bvh, first + i), point, precision);
+			}
+		}
+		for (uint32_t i = 0; i < count; ++i) {
+			best = std::min(best, values[i]);
+		}
+	});
+	return best;
+}
+
+// Primitives can only lower the union when their interval starts below the
+// smallest end seen so far, others are skipped.
+static Interval get_interval(Program::Bvh const &bvh, Rect rect, EvalPrecision precision) {
+	Interval result = {std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
+	walk_bvh(bvh, rect, result.max, [&](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			Ellipse ellipse = get_ellipse(bvh, i);
+			Interval interval = bvh.is_circles ? get_interval(Circle{ellipse.center, ellipse.radius.x}, rect) : get_interval(ellipse, rect, precision);
+			result = {std::min(result.min, interval.min), std::min(result.max, interval.max)};
+		}
+	});
+	return result;
+}
+
+// First registers of every kind of primitive in a program. Constants start at
+// zero and registers of instructions start at end.
+struct PrimitiveRegisters {
+	uint32_t planes;
+	uint32_t circles;
+	uint32_t ellipses;
+	uint32_t end;
+};
+
+static PrimitiveRegisters get_primitive_registers(Program const &program) {
+	PrimitiveRegisters result;
+	result.planes = program.constants.size();
+	result.circles = result.planes + program.planes.offset.size();
+	result.ellipses = result.circles + program.circles.radius.size();
+	result.end = result.ellipses + program.ellipses.radius_x.size();
+	return result;
+}
+
+static Plane get_plane(Program const &program, uint32_t index) {
+	auto &planes = program.planes;
+	return {{planes.normal_x[index], planes.normal_y[index]}, planes.offset[index]};
+}
+
+static Circle get_circle(Program const &program, uint32_t index) {
+	auto &circles = program.circles;
+	return {{circles.center_x[index], circles.center_y[index]}, circles.radius[index]};
+}
+
+static Ellipse get_ellipse(Program const &program, uint32_t index) {
+	auto &ellipses = program.ellipses;
+	return {{ellipses.center_x[index], ellipses.center_y[index]}, {ellipses.radius_x[index], ellipses.radius_y[index]}};
+}
+
+// Kinds of primitives stored in Program, in the order of their registers.
+enum class ProgramPrimitiveKind : uint8_t {
+	constant,
+	plane,
+	circle,
+	ellipse,
+};
+
+struct ProgramPrimitive {
+	ProgramPrimitiveKind kind;
+	uint32_t index;
+};
+
+// Appends primitive to the arrays of its kind and returns where it went.
+static ProgramPrimitive add_primitive(Program &program, Scene const &scene, Primitive const &primitive) {
+	switch (primitive.kind) {
+		case Primitive::Kind::float1: {
+			program.constants.push_back(primitive.float1);
+			return {ProgramPrimitiveKind::constant, (uint32_t)program.constants.size() - 1};
+		}
+		case Primitive::Kind::plane: {
+			Plane plane = scale_plane(primitive.plane, scene.scale);
+			auto &planes = program.planes;
+			planes.normal_x.push_back(plane.normal.x);
+			planes.normal_y.push_back(plane.normal.y);
+			planes.offset.push_back(plane.offset);
+			return {ProgramPrimitiveKind::plane, (uint32_t)planes.offset.size() - 1};
+		}
+		case Primitive::Kind::circle: {
+			Ellipse ellipse = {.center = scene.scale * primitive.circle.center, .radius = scene.scale * primitive.circle.radius};
+			if (ellipse.radius.x == ellipse.radius.y) {
+				// distance(Ellipse) does the same in this case.
+				auto &circles = program.circles;
+				circles.center_x.push_back(ellipse.center.x);
+				circles.center_y.push_back(ellipse.center.y);
+				circles.radius.push_back(ellipse.radius.x);
+				return {ProgramPrimitiveKind::circle, (uint32_t)circles.radius.size() - 1};
+			}
+			auto &ellipses = program.ellipses;
+			ellipses.center_x.push_back(ellipse.center.x);
+			ellipses.center_y.push_back(ellipse.center.y);
+			ellipses.radius_x.push_back(ellipse.radius.x);
+			ellipses.radius_y.push_back(ellipse.radius.y);
+			return {ProgramPrimitiveKind::ellipse, (uint32_t)ellipses.radius_x.size() - 1};
+		}
+		default:
+			assert(!"invalid Primitive::Kind");
+			return {};
+	}
+}
+
+static uint32_t get_register(PrimitiveRegisters const &first, ProgramPrimitive primitive) {
+	switch (primitive.kind) {
+		case ProgramPrimitiveKind::constant: return primitive.index;
+		case ProgramPrimitiveKind::plane:    return first.planes + primitive.index;
+		case ProgramPrimitiveKind::circle:   return first.circles + primitive.index;
+		case ProgramPrimitiveKind::ellipse:  return first.ellipses + primitive.index;
+		default:
+			assert(!"invalid ProgramPrimitiveKind");
+			return 0;
+	}
+}
+
+std::optional<Program> compile(Scene const &scene, Object const &object_to_compile, EvalPrecision precision) {
+	Object object = object_to_compile;
+	optimize(object);
+
+	Program program;
+	program.precision = precision;
+
+	if (object.operations.size() == 0) {
+		if (object.primitives.size() == 0) {
+			program.constants.push_back(std::numeric_limits<float>::infinity());
+		} else {
+			add_primitive(program, scene, object.primitives.back());
+		}
+		program.register_count = 1;
+		program.result = 0;
+		return program;
+	}
+
+	// Every primitive and operation result is a value. Primitives have a register
+	// each, operation results stay in their register until the last operation
+	// that uses them.
+	uint32_t primitive_count = object.primitives.size();
+	uint32_t value_count = primitive_count + object.operations.size();
+
+	auto is_valid = [&](ArgumentIndex index, uint32_t operation_index) {
+		return index.kind == ArgumentIndex::Kind::object_primitive || index.value < operation_index;
+	};
+	auto get_value = [&](ArgumentIndex index) -> uint32_t {
+		return index.kind == ArgumentIndex::Kind::object_primitive ? index.value : primitive_count + index.value;
+	};
+
+	// Circles of large unions don't get registers, they go to a Program::Bvh.
+	// Its bounds need finite centers and positive finite radii.
+	auto get_bvh_primitive = [&](ArgumentIndex index, Ellipse *ellipse) {
+		if (index.kind != ArgumentIndex::Kind::object_primitive)
+			return false;
+		auto &primitive = object.primitives[index.value];
+		if (primitive.kind != Primitive::Kind::circle)
+			return false;
+		*ellipse = {.center = scene.scale * primitive.circle.center, .radius = scene.scale * primitive.circle.radius};
+		return isfinite(ellipse->center.x) && isfinite(ellipse->center.y) &&
+			ellipse->radius.x > 0 && ellipse->radius.y > 0 && isfinite(ellipse->radius.x) && isfinite(ellipse->radius.y);
+	};
+	std::vector<bool> uses_bvh(object.operations.size());
+	uint32_t bvh_count = 0;
+	for (uint32_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		auto &operation = object.operations[operation_index];
+		if (operation.kind != Operation::Kind::min_range)
+			continue;
+		uint32_t count = 0;
+		for_each_argument(operation, [&](ArgumentIndex index) {
+			Ellipse ellipse;
+			count += get_bvh_primitive(index, &ellipse);
+		});
+		// Instructions refer to trees with a 16 bit index.
+		uses_bvh[operation_index] = count >= bvh_min_primitive_count && bvh_count < Program::max_register_count;
+		bvh_count += uses_bvh[operation_index];
+	}
+	auto is_in_bvh = [&](ArgumentIndex index, uint32_t operation_index) {
+		Ellipse ellipse;
+		return uses_bvh[operation_index] && get_bvh_primitive(index, &ellipse);
+	};
+
+	constexpr uint32_t unused = ~0u;
+
+	// Index of the last operation that uses each value.
+	std::vector<uint32_t> last_uses(value_count, unused);
+	bool has_invalid_references = false;
+	for (uint32_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		auto &operation = object.operations[operation_index];
+		if (is_range(operation.kind) && !is_valid_range(operation)) {
+			has_invalid_references = true;
+		}
+		for_each_argument(operation, [&](ArgumentIndex index) {
+			if (is_in_bvh(index, operation_index)) {
+				return;
+			}
+			if (is_valid(index, operation_index)) {
+				last_uses[get_value(index)] = operation_index;
+			} else {
+				has_invalid_references = true;
+			}
+		});
+	}
+
+	// Invalid references read a NaN constant.
+	std::optional<ProgramPrimitive> nan;
+	if (has_invalid_references) {
+		nan = add_primitive(program, scene, Primitive(std::numeric_limits<float>::quiet_NaN()));
+	}
+
+	std::vector<ProgramPrimitive> primitives(primitive_count);
+	for (uint32_t primitive_index = 0; primitive_index < primitive_count; ++primitive_index) {
+		if (last_uses[primitive_index] != unused) {
+			primitives[primitive_index] = add_primitive(program, scene, object.primitives[primitive_index]);
+		}
+	}
+
+	PrimitiveRegisters first = get_primitive_registers(program);
+	if (first.end > Program::max_register_count)
+		return {};
+
+	std::vector<uint32_t> registers(value_count);
+	for (uint32_t primitive_index = 0; primitive_index < primitive_count; ++primitive_index) {
+		if (last_uses[primitive_index] != unused) {
+			registers[primitive_index] = get_register(first, primitives[primitive_index]);
+		}
+	}
+	uint32_t nan_register = nan ? get_register(first, *nan) : 0;
+
+	std::vector<uint32_t> free_registers;
+	bool out_of_registers = false;
+	program.register_count = first.end;
+
+	auto allocate_register = [&]() -> uint32_t {
+		if (free_registers.size()) {
+			uint32_t result = free_registers.back();
+			free_registers.pop_back();
+			return result;
+		}
+		if (program.register_count == Program::max_register_count) {
+			out_of_registers = true;
+			return 0;
+		}
+		return program.register_count++;
+	};
+
+	for (uint32_t operation_index = 0; operation_index < object.operations.size(); ++operation_index) {
+		auto &operation = object.operations[operation_index];
+		uint32_t result = primitive_count + operation_index;
+
+		auto get_source = [&](ArgumentIndex index) -> uint16_t {
+			return is_valid(index, operation_index) ? registers[get_value(index)] : nan_register;
+		};
+
+		if (is_range(operation.kind)) {
+			// Folded into the destination in argument order, like split_ranges does,
+			// except that the tree of a union goes first. The destination is written
+			// before all sources are read, so their registers are freed afterwards.
+			auto kind = operation.kind == Operation::Kind::min_range ? Program::Instruction::Kind::min : Program::Instruction::Kind::max;
+			uint16_t destination = registers[result] = allocate_register();
+			bool is_first = true;
+			auto fold = [&](uint16_t source) {
+				if (is_first) {
+					program.instructions.push_back({.kind = Program::Instruction::Kind::copy, .destination = destination, .sources = {source}});
+				} else {
+					program.instructions.push_back({.kind = kind, .destination = destination, .sources = {destination, source}});
+				}
+				is_first = false;
+			};
+
+			if (uses_bvh[operation_index]) {
+				std::vector<Ellipse> ellipses;
+				bool is_circles = true;
+				for_each_argument(operation, [&](ArgumentIndex index) {
+					Ellipse ellipse;
+					if (get_bvh_primitive(index, &ellipse)) {
+						ellipses.push_back(ellipse);
+						is_circles &= ellipse.radius.x == ellipse.radius.y;
+					}
+				});
+				program.bvhs.push_back(build_bvh(std::move(ellipses), is_circles));
+				program.instructions.push_back({.kind = Program::Instruction::Kind::min_bvh, .destination = destination, .sources = {uint16_t(program.bvhs.size() - 1)}});
+				is_first = false;
+			}
+
+			if (!is_valid_range(operation)) {
+				fold(nan_register);
+			}
+			for_each_argument(operation, [&](ArgumentIndex index) {
+				if (!is_in_bvh(index, operation_index)) {
+					fold(get_source(index));
+				}
+			});
+
+			for_each_argument(operation, [&](ArgumentIndex index) {
+				if (index.kind == ArgumentIndex::Kind::object_operation && is_valid(index, operation_index) && last_uses[get_value(index)] == operation_index) {
+					free_registers.push_back(registers[get_value(index)]);
+				}
+			});
+
+			if (last_uses[result] == unused && operation_index != object.operations.size() - 1) {
+				free_registers.push_back(registers[result]);
+			}
+			continue;
+		}
+
+		uint32_t arity = get_arity(operation.kind);
+
+		Program::Instruction instruction = {};
+
+		switch (operation.kind) {
+			#define x(name, value, arity) case Operation::Kind::name: instruction.kind = Program::Instruction::Kind::name; break;
+			SDFD_ENUMERATE_OPERATION(x)
+			#undef x
+
+			default:
+				assert(!"invalid Operation::Kind");
+		}
+
+		for (uint32_t i = 0; i < arity; ++i) {
+			instruction.sources[i] = get_source(operation.args[i]);
+		}
+
+		// Sources are read before the destination is written, so their registers can be reused right away.
+		// Registers of primitives are never reused.
+		for (uint32_t i = 0; i < arity; ++i) {
+			ArgumentIndex index = operation.args[i];
+			if (index.kind == ArgumentIndex::Kind::object_operation && is_valid(index, operation_index) && last_uses[get_value(index)] == operation_index) {
+				bool already_freed = i == 1 && operation.args[0].kind == index.kind && operation.args[0].value == index.value;
+				if (!already_freed) {
+					free_registers.push_back(registers[get_value(index)]);
+				}
+			}
+		}
+
+		registers[result] = instruction.destination = allocate_register();
+		program.instructions.push_back(instruction);
+
+		if (last_uses[result] == unused && operation_index != object.operations.size() - 1) {
+			free_registers.push_back(registers[result]);
+		}
+	}
+
+	if (out_of_registers)
+		return {};
+
+	program.result = registers.back();
+	return program;
+}
+
+float evaluate(Program const &program, Vector2 point) {
+	using Kind = Program::Instruction::Kind;
+
+	// Registers of instructions are reused once their value is no longer needed,
+	// but every primitive has its own register, so they fit on the stack only for
+	// objects of up to a few hundred primitives. Larger programs use the context.
+	// Evaluating primitives when instructions read them would need storage for
+	// instructions only, but branching on the kind of every source and giving up
+	// the kernels made it about twice as slow for objects of 40 primitives.
+	constexpr uint32_t stack_register_count = 256;
+	float stack_registers[stack_register_count];
+	float *registers = stack_registers;
+	if (program.register_count > stack_register_count) {
+		auto &context = get_thread_context();
+		if (context.program_rows.size() < program.register_count) {
+			context.program_rows.resize(program.register_count);
+		}
+		registers = context.program_rows.data();
+	}
+
+	auto &kernels = get_kernels();
+	PrimitiveRegisters first = get_primitive_registers(program);
+
+	// Calling a kernel costs more than it saves until there is about a vector of primitives.
+	constexpr uint32_t min_kernel_count = 16;
+
+	std::copy(program.constants.begin(), program.constants.end(), registers);
+
+	auto &planes = program.planes;
+	uint32_t plane_count = first.circles - first.planes;
+	if (plane_count >= min_kernel_count) {
+		kernels.planes_at_point(planes.normal_x.data(), planes.normal_y.data(), planes.offset.data(), point, registers + first.planes, plane_count);
+	} else {
+		for (uint32_t i = 0; i < plane_count; ++i) {
+			registers[first.planes + i] = planes.normal_x[i]*point.x + planes.normal_y[i]*point.y - planes.offset[i];
+		}
+	}
+
+	auto &circles = program.circles;
+	uint32_t circle_count = first.ellipses - first.circles;
+	if (circle_count >= min_kernel_count) {
+		kernels.circles_at_point(circles.center_x.data(), circles.center_y.data(), circles.radius.data(), point, registers + first.circles, circle_count);
+	} else {
+		for (uint32_t i = 0; i < circle_count; ++i) {
+			registers[first.circles + i] = distance(get_circle(program, i), point);
+		}
+	}
+
+	for (uint32_t i = 0; i < first.end - first.ellipses; ++i) {
+		registers[first.ellipses + i] = distance(get_ellipse(program, i), point, program.precision);
+	}
+
+	for (auto &instruction : program.instructions) {
+		float &destination = registers[instruction.destination];
+		switch (instruction.kind) {
+			case Kind::min:  destination = std::min(registers[instruction.sources[0]], registers[instruction.sources[1]]); break;
+			case Kind::max:  destination = std::max(registers[instruction.sources[0]], registers[instruction.sources[1]]); break;
+			case Kind::copy: destination = registers[instruction.sources[0]]; break;
+			case Kind::min_bvh: destination = evaluate_bvh(*program.bvhs[instruction.sources[0]], point, program.precision); break;
+			case Kind::neg:  destination = -registers[instruction.sources[0]]; break;
+			case Kind::max_neg: destination = std::max(registers[instruction.sources[0]], -registers[instruction.sources[1]]); break;
+			default:
+				assert(!"invalid Program::Instruction::Kind");
+		}
+	}
+
+	return registers[program.result];
+}
+
+static uint32_t get_source_count(Program::Instruction::Kind kind) {
+	switch (kind) {
+		case Program::Instruction::Kind::copy: return 1;
+		case Program::Instruction::Kind::min_bvh: return 0;
+		#define x(name, value, arity) case Program::Instruction::Kind::name: return arity;
+		SDFD_ENUMERATE_OPERATION(x)
+		#undef x
+		default: return 0;
+	}
+}
+
+// Storage for evaluating a program over chunks of points, points into EvalContext::program_rows.
+// Holds a row for every register. Nothing writes rows of constants, so they are filled once.
+struct ProgramScratch {
+	float *rows;
+
+	// Primitives read only once are written to temporary rows right before
+	// they are read, one for each source of an instruction, so the row is
+	// still in cache. Others get their own row, written on first read.
+	float *temporary[2];
+
+	// Flags of every primitive after the constants.
+	uint8_t *primitive_flags;
+
+	std::size_t chunk_size;
+
+	float *row(uint32_t index) { return rows + index * chunk_size; }
+};
+
+static constexpr uint8_t primitive_shared_flag = 1;
+static constexpr uint8_t primitive_written_flag = 2;
+
+static ProgramScratch prepare_program_scratch(EvalContext &context, Program const &program) {
+	PrimitiveRegisters first = get_primitive_registers(program);
+
+	std::size_t row_count = program.register_count + 2;
+	std::size_t chunk_size = std::clamp(batch_scratch_budget / row_count, batch_min_chunk_size, batch_chunk_size);
+	if (context.program_rows.size() < row_count * chunk_size) {
+		context.program_rows.resize(row_count * chunk_size);
+	}
+	if (context.program_primitive_flags.size() < first.end - first.planes) {
+		context.program_primitive_flags.resize(first.end - first.planes);
+	}
+
+	ProgramScratch scratch = {
+		.rows = context.program_rows.data(),
+		.temporary = {
+			context.program_rows.data() + program.register_count * chunk_size,
+			context.program_rows.data() + (program.register_count + 1) * chunk_size,
+		},
+		.primitive_flags = context.program_primitive_flags.data(),
+		.chunk_size = chunk_size,
+	};
+	for (uint32_t i = 0; i < program.constants.size(); ++i) {
+		std::fill_n(scratch.row(i), chunk_size, program.constants[i]);
+	}
+
+	// Reads are counted up to two with the flags, the written one is cleared
+	// before every chunk.
+	std::fill_n(scratch.primitive_flags, first.end - first.planes, 0);
+	auto add_read = [&](uint32_t index) {
+		if (index >= first.planes && index < first.end) {
+			uint8_t &flags = scratch.primitive_flags[index - first.planes];
+			flags |= flags & primitive_written_flag ? primitive_shared_flag : primitive_written_flag;
+		}
+	};
+	for (auto &instruction : program.instructions) {
+		for (uint32_t i = 0; i < get_source_count(instruction.kind); ++i) {
+			add_read(instruction.sources[i]);
+		}
+	}
+	add_read(program.result);
+
+	return scratch;
+}
+
+// Every primitive is evaluated right before the first instruction that reads
+// it. Writing rows of all primitives first goes through memory for programs
+// with many of them.
+static void evaluate_batch_chunk(Program const &program, float const *xs, float const *ys, float *out, std::size_t count, ProgramScratch &scratch) {
+	using Kind = Program::Instruction::Kind;
+
+	auto &kernels = get_kernels();
+	PrimitiveRegisters first = get_primitive_registers(program);
+
+	for (uint32_t i = 0; i < first.end - first.planes; ++i) {
+		scratch.primitive_flags[i] &= primitive_shared_flag;
+	}
+
+	// Returns row of register index for source number slot of an instruction,
+	// evaluating it first if it is a primitive that has not been.
+	auto source = [&](uint32_t index, uint32_t slot) -> float const * {
+		if (index < first.planes || index >= first.end)
+			return scratch.row(index);
+
+		uint8_t &flags = scratch.primitive_flags[index - first.planes];
+		if (flags & primitive_written_flag)
+			return scratch.row(index);
+
+		float *row = flags & primitive_shared_flag ? scratch.row(index) : scratch.temporary[slot];
+		if (index < first.circles) {
+			kernels.plane(get_plane(program, index - first.planes), xs, ys, row, count);
+		} else if (index < first.ellipses) {
+			kernels.circle(get_circle(program, index - first.circles), xs, ys, row, count);
+		} else {
+			evaluate_ellipse_batch(get_ellipse(program, index - first.ellipses), program.precision, xs, ys, row, count);
+		}
+		flags |= primitive_written_flag;
+		return row;
+	};
+
+	for (auto &instruction : program.instructions) {
+		float *destination = scratch.row(instruction.destination);
+		switch (instruction.kind) {
+			case Kind::copy: {
+				if (instruction.sources[0] != instruction.destination) {
+					memcpy(destination, source(instruction.sources[0], 0), count * sizeof(float));
+				}
+				break;
+			}
+			case Kind::min_bvh: {
+				auto &bvh = *program.bvhs[instruction.sources[0]];
+				for (std::size_t i = 0; i < count; ++i) {
+					destination[i] = evaluate_bvh(bvh, {xs[i], ys[i]}, program.precision);
+				}
+				break;
+			}
+			case Kind::min:
+			case Kind::max: {
+				// A plane or circle that only this reads is folded into the other source.
+				bool is_max = instruction.kind == Kind::max;
+				uint32_t index = instruction.sources[1];
+				if (index >= first.planes && index < first.ellipses && !(scratch.primitive_flags[index - first.planes] & primitive_shared_flag)) {
+					float const *a = source(instruction.sources[0], 0);
+					if (index < first.circles) {
+						kernels.plane_fold(get_plane(program, index - first.planes), is_max, xs, ys, a, destination, count);
+					} else {
+						kernels.circle_fold(get_circle(program, index - first.circles), is_max, xs, ys, a, destination, count);
+					}
+				} else if (is_max) {
+					kernels.max(source(instruction.sources[0], 0), source(instruction.sources[1], 1), destination, count);
+				} else {
+					kernels.min(source(instruction.sources[0], 0), source(instruction.sources[1], 1), destination, count);
+				}
+				break;
+			}
+			case Kind::neg: kernels.neg(source(instruction.sources[0], 0), destination, count); break;
+			case Kind::max_neg: kernels.max_neg(source(instruction.sources[0], 0), source(instruction.sources[1], 1), destination, count); break;
+			default:
+				assert(!"invalid Program::Instruction::Kind");
+		}
+	}
+
+	memcpy(out, source(program.result, 0), count * sizeof(float));
+}
+
+void evaluate_batch(Program const &program, std::span<Vector2 const> points, std::span<float> out) {
+	evaluate_batch(get_thread_context(), program, points, out);
+}
+
+void evaluate_batch(EvalContext &context, Program const &program, std::span<Vector2 const> points, std::span<float> out) {
+	assert(out.size() >= points.size());
+
+	ProgramScratch scratch = prepare_program_scratch(context, program);
+
+	float xs[batch_chunk_size];
+	float ys[batch_chunk_size];
+
+	for (std::size_t start = 0; start < points.size(); start += scratch.chunk_size) {
+		std::size_t count = std::min(scratch.chunk_size, points.size() - start);
+		for (std::size_t i = 0; i < count; ++i) {
+			xs[i] = points[start + i].x;
+			ys[i] = points[start + i].y;
+		}
+		evaluate_batch_chunk(program, xs, ys, out.data() + start, count, scratch);
+	}
+}
+
+void evaluate_batch(Program const &program, std::span<float const> xs, std::span<float const> ys, std::span<float> out) {
+	evaluate_batch(get_thread_context(), program, xs, ys, out);
+}
+
+void evaluate_batch(EvalContext &context, Program const &program, std::span<float const> xs, std::span<float const> ys, std::span<float> out) {
+	assert(xs.size() == ys.size());
+	assert(out.size() >= xs.size());
+
+	ProgramScratch scratch = prepare_program_scratch(context, program);
+
+	for (std::size_t start = 0; start < xs.size(); start += scratch.chunk_size) {
+		std::size_t count = std::min(scratch.chunk_size, xs.size() - start);
+		evaluate_batch_chunk(program, xs.data() + start, ys.data() + start, out.data() + start, count, scratch);
+	}
+}
+
+// Removes instructions whose results are not read before being overwritten
+// or the end of the program, then primitives that nothing reads.
+static void remove_dead_instructions(EvalContext &context, Program &program) {
+	auto &needed = context.program_registers;
+	needed.assign(program.register_count, 0);
+	needed[program.result] = 1;
+
+	// Kept instructions are moved to the end, then the rest is erased.
+	auto &instructions = program.instructions;
+	std::size_t first_kept = instructions.size();
+	for (std::size_t i = instructions.size(); i--;) {
+		Program::Instruction instruction = instructions[i];
+		if (!needed[instruction.destination])
+			continue;
+		if (instruction.kind == Program::Instruction::Kind::copy && instruction.sources[0] == instruction.destination)
+			continue;
+
+		needed[instruction.destination] = 0;
+		for (uint32_t s = 0; s < get_source_count(instruction.kind); ++s) {
+			needed[instruction.sources[s]] = 1;
+		}
+		instructions[--first_kept] = instruction;
+	}
+	instructions.erase(instructions.begin(), instructions.begin() + first_kept);
+
+	// Instructions never write registers of primitives, so primitives that are
+	// still needed are the ones that are read. They are moved to the front of
+	// their arrays and needed becomes their new register.
+	PrimitiveRegisters first = get_primitive_registers(program);
+	uint32_t kept_primitive_count = 0;
+	auto compact = [&](uint32_t begin, uint32_t end, auto &...arrays) {
+		uint32_t kept = 0;
+		for (uint32_t i = 0; i < end - begin; ++i) {
+			if (!needed[begin + i])
+				continue;
+			((arrays[kept] = arrays[i]), ...);
+			needed[begin + i] = kept_primitive_count + kept;
+			++kept;
+		}
+		(arrays.resize(kept), ...);
+		kept_primitive_count += kept;
+	};
+	compact(0, first.planes, program.constants);
+	compact(first.planes, first.circles, program.planes.normal_x, program.planes.normal_y, program.planes.offset);
+	compact(first.circles, first.ellipses, program.circles.center_x, program.circles.center_y, program.circles.radius);
+	compact(first.ellipses, first.end, program.ellipses.center_x, program.ellipses.center_y, program.ellipses.radius_x, program.ellipses.radius_y);
+
+	auto renumber = [&](uint16_t index) -> uint16_t {
+		return index < first.end ? needed[index] : index - first.end + kept_primitive_count;
+	};
+	for (auto &instruction : instructions) {
+		instruction.destination = renumber(instruction.destination);
+		for (uint32_t s = 0; s < get_source_count(instruction.kind); ++s) {
+			instruction.sources[s] = renumber(instruction.sources[s]);
+		}
+	}
+	program.result = renumber(program.result);
+	program.register_count = program.register_count - first.end + kept_primitive_count;
+}
+
+// Replaces min_bvh instructions at indices in expanded with min of the primitives
+// specialize_into appended for them, their sources[1] says how many. Registers of
+// primitives started at old_first before the primitives were appended.
+static void expand_bvhs(Program &program, PrimitiveRegisters const &old_first, std::vector<uint32_t> const &expanded) {
+	using Kind = Program::Instruction::Kind;
+
+	PrimitiveRegisters first = get_primitive_registers(program);
+	auto renumber = [&](uint16_t index) -> uint16_t {
+		if (index < old_first.ellipses)
+			return index;
+		if (index < old_first.end)
+			return index - old_first.ellipses + first.ellipses;
+		return index - old_first.end + first.end;
+	};
+
+	auto &instructions = program.instructions;
+	std::size_t old_size = instructions.size();
+	for (uint32_t i : expanded) {
+		instructions.resize(instructions.size() + instructions[i].sources[1] - 1);
+	}
+
+	// Filled from the back, so that instructions are moved before they are overwritten.
+	uint32_t circle_end = first.ellipses - first.circles;
+	uint32_t ellipse_end = first.end - first.ellipses;
+	std::size_t write = instructions.size();
+	std::size_t next = expanded.size();
+	for (std::size_t i = old_size; i--;) {
+		Program::Instruction instruction = instructions[i];
+		instruction.destination = renumber(instruction.destination);
+
+		if (next && expanded[next - 1] == i) {
+			--next;
+			bool is_circles = program.bvhs[instruction.sources[0]]->is_circles;
+			uint32_t count = instruction.sources[1];
+			uint32_t &end = is_circles ? circle_end : ellipse_end;
+			end -= count;
+			uint32_t primitives = (is_circles ? first.circles : first.ellipses) + end;
+			for (uint32_t j = count; j--;) {
+				if (j == 0) {
+					instructions[--write] = {.kind = Kind::copy, .destination = instruction.destination, .sources = {uint16_t(primitives)}};
+				} else {
+					instructions[--write] = {.kind = Kind::min, .destination = instruction.destination, .sources = {instruction.destination, uint16_t(primitives + j)}};
+				}
+			}
+			continue;
+		}
+
+		for (uint32_t s = 0; s < get_source_count(instruction.kind); ++s) {
+			instruction.sources[s] = renumber(instruction.sources[s]);
+		}
+		instructions[--write] = instruction;
+	}
+	program.result = renumber(program.result);
+}
+
+// Returns interval of program over rect. If out is not null, also writes the
+// program specialized for rect to it, reusing its storage.
+static Interval specialize_into(EvalContext &context, Program const &program, Rect rect, Program *out) {
+	using Kind = Program::Instruction::Kind;
+
+	auto &registers = context.program_intervals;
+	if (registers.size() < program.register_count) {
+		registers.resize(program.register_count);
+	}
+
+	PrimitiveRegisters first = get_primitive_registers(program);
+	for (uint32_t i = 0; i < first.planes; ++i) {
+		registers[i] = {program.constants[i], program.constants[i]};
+	}
+	for (uint32_t i = 0; i < first.circles - first.planes; ++i) {
+		registers[first.planes + i] = get_interval(get_plane(program, i), rect);
+	}
+	for (uint32_t i = 0; i < first.ellipses - first.circles; ++i) {
+		registers[first.circles + i] = get_interval(get_circle(program, i), rect);
+	}
+	for (uint32_t i = 0; i < first.end - first.ellipses; ++i) {
+		registers[first.ellipses + i] = get_interval(get_ellipse(program, i), rect, program.precision);
+	}
+
+	auto &expanded = context.program_expanded;
+	expanded.clear();
+
+	if (out) {
+		out->constants = program.constants;
+		out->planes = program.planes;
+		out->circles = program.circles;
+		out->ellipses = program.ellipses;
+		out->bvhs = program.bvhs;
+		out->instructions.clear();
+		out->register_count = program.register_count;
+		out->result = program.result;
+		out->precision = program.precision;
+	}
+
+	for (auto &instruction : program.instructions) {
+		Program::Instruction specialized = instruction;
+		Interval result = {};
+
+		// Picking the argument is exactly what std::min and std::max do when
+		// one argument is never greater or never less than the other. Comparisons
+		// with NaN are false, so nothing is pruned then.
+		auto pick = [&](uint32_t source_index) {
+			specialized.kind = Kind::copy;
+			specialized.sources[0] = instruction.sources[source_index];
+		};
+
+		switch (instruction.kind) {
+			case Kind::copy: result = registers[instruction.sources[0]]; break;
+			case Kind::min_bvh: {
+				auto &bvh = *program.bvhs[instruction.sources[0]];
+				result = get_interval(bvh, rect, program.precision);
+				if (!out)
+					break;
+
+				// Primitives whose interval starts at or after the end of the one
+				// of the union are never the smallest in rect. When few are left,
+				// they are appended to out and replace the tree in expand_bvhs.
+				float bound = result.max;
+				uint32_t count = 0;
+				walk_bvh(bvh, rect, bound, [&](uint32_t leaf_first, uint32_t leaf_count) {
+					for (uint32_t i = leaf_first; i < leaf_first + leaf_count; ++i) {
+						Ellipse ellipse = get_ellipse(bvh, i);
+						Interval interval = bvh.is_circles ? get_interval(Circle{ellipse.center, ellipse.radius.x}, rect) : get_interval(ellipse, rect, program.precision);
+						if (!(interval.min < result.max))
+							continue;
+						if (count == bvh_max_expanded_count || out->register_count + count == Program::max_register_count) {
+							// Stops the walk.
+							bound = -std::numeric_limits<float>::infinity();
+							return;
+						}
+						if (bvh.is_circles) {
+							out->circles.center_x.push_back(ellipse.center.x);
+							out->circles.center_y.push_back(ellipse.center.y);
+							out->circles.radius.push_back(ellipse.radius.x);
+						} else {
+							out->ellipses.center_x.push_back(ellipse.center.x);
+							out->ellipses.center_y.push_back(ellipse.center.y);
+							out->ellipses.radius_x.push_back(ellipse.radius.x);
+							out->ellipses.radius_y.push_back(ellipse.radius.y);
+						}
+						++count;
+					}
+				});
+
+				if (count && bound != -std::numeric_limits<float>::infinity()) {
+					specialized.sources[1] = count;
+					out->register_count += count;
+					expanded.push_back(out->instructions.size());
+				} else if (bvh.is_circles) {
+					auto &circles = out->circles;
+					uint32_t size = circles.radius.size() - count;
+					circles.center_x.resize(size);
+					circles.center_y.resize(size);
+					circles.radius.resize(size);
+				} else {
+					auto &ellipses = out->ellipses;
+					uint32_t size = ellipses.radius_x.size() - count;
+					ellipses.center_x.resize(size);
+					ellipses.center_y.resize(size);
+					ellipses.radius_x.resize(size);
+					ellipses.radius_y.resize(size);
+				}
+				break;
+			}
+			case Kind::min: {
+				Interval a = registers[instruction.sources[0]];
+				Interval b = registers[instruction.sources[1]];
+				if (a.max <= b.min) {
+					pick(0);
+				} else if (b.max <= a.min) {
+					pick(1);
+				}
+				result = {std::min(a.min, b.min), std::min(a.max, b.max)};
+				break;
+			}
+			case Kind::max: {
+				Interval a = registers[instruction.sources[0]];
+				Interval b = registers[instruction.sources[1]];
+				if (a.min >= b.max) {
+					pick(0);
+				} else if (b.min >= a.max) {
+					pick(1);
+				}
+				result = {std::max(a.min, b.min), std::max(a.max, b.max)};
+				break;
+			}
+			case Kind::neg: {
+				Interval a = registers[instruction.sources[0]];
+				result = {-a.max, -a.min};
+				break;
+			}
+			case Kind::max_neg: {
+				Interval a = registers[instruction.sources[0]];
+				Interval b = registers[instruction.sources[1]];
+				if (a.min >= -b.min) {
+					pick(0);
+				} else if (-b.max >= a.max) {
+					specialized.kind = Kind::neg;
+					specialized.sources[0] = instruction.sources[1];
+				}
+				result = {std::max(a.min, -b.max), std::max(a.max, -b.min)};
+				break;
+			}
+			default:
+				assert(!"invalid Program::Instruction::Kind");
+		}
+
+		registers[instruction.destination] = result;
+
+		if (out) {
+			out->instructions.push_back(specialized);
+		}
+	}
+
+	if (out) {
+		if (expanded.size()) {
+			expand_bvhs(*out, first, expanded);
+		}
+		remove_dead_instructions(context, *out);
+	}
+
+	return registers[program.result];
+}
+
+Interval evaluate_interval(Program const &program, Rect rect) {
+	return specialize_into(get_thread_context(), program, rect, nullptr);
+}
+
+Program specialize(Program const &program, Rect rect) {
+	Program result;
+	specialize_into(get_thread_context(), program, rect, &result);
+	return result;
+}
+
+// Tiles are split until they are this small, then pixels are evaluated.
+static constexpr uint32_t raster_leaf_size = 8;
+
+// Image is processed in tiles of this size.
+static constexpr uint32_t raster_root_size = 64;
+
+// Tiles are halved from root to leaf size, so there are at most this many levels.
+static constexpr uint32_t raster_max_depth = 8;
+
+// rgba8_lcd evaluates this many points per pixel.
+static constexpr uint32_t raster_max_samples_per_pixel = 3;
+
+// Weights of FreeType's FT_LCD_FILTER_DEFAULT, they sum to 256.
+static constexpr float lcd_filter_weights[] = {0x08 / 256.0f, 0x4D / 256.0f, 0x56 / 256.0f, 0x4D / 256.0f, 0x08 / 256.0f};
+
+// The filter reads this many subpixels on both sides of the row.
+static constexpr uint32_t raster_max_margin_samples = 2;
+
+static Vector2 pixel_center(Viewport const &viewport, uint32_t x, uint32_t y) {
+	return viewport.origin + viewport.x_axis * (x + 0.5f) + viewport.y_axis * (y + 0.5f);
+}
+
+struct RasterState {
+	EvalContext &context;
+	Scene const &scene;
+	Object const &object;
+	Viewport const &viewport;
+	RasterTarget const &target;
+
+	// Distances are clamped to [-band, band] before conversion. Tiles outside
+	// of that are filled.
+	float band = 0;
+
+	// Multiplier that maps distance to what the format stores.
+	float scale = 1;
+
+	// Samples of a pixel are at its center + (i - (samples_per_pixel - 1) / 2) * sample_step,
+	// sample_step is x_axis / samples_per_pixel.
+	uint32_t samples_per_pixel = 1;
+	Vector2 sample_step = {0, 0};
+
+	// Extra samples evaluated before and after every row of a tile.
+	uint32_t margin_samples = 0;
+
+	// Used when object is evaluated without a program.
+	EvalPrecision precision = EvalPrecision::exact;
+
+	// Tiles farther than band from bounds of the object are filled without
+	// evaluating it. Unbounded with EvalPrecision::bound, see get_bounds.
+	Rect bounds = everywhere;
+};
+
+static uint32_t get_pixel_size(PixelFormat format) {
+	switch (format) {
+		case PixelFormat::distance_f32:    return 4;
+		case PixelFormat::distance_snorm8: return 1;
+		case PixelFormat::distance_unorm8: return 1;
+		case PixelFormat::alpha8:          return 1;
+		case PixelFormat::rgba8:           return 4;
+		case PixelFormat::rgba8_lcd:       return 4;
+	}
+	assert(!"invalid PixelFormat");
+	return 0;
+}
+
+// Maps coverage in [0, 1] to [0, 255], same as multiplying by 256 and clamping.
+static uint8_t coverage_to_unorm8(float coverage) {
+	return (uint8_t)(coverage * nextafterf(256, -1));
+}
+
+// Converts count pixels worth of distances to target format and writes them to
+// row starting at pixel x. distances starts with state.margin_samples extra
+// samples and has as many after. Loops are branch free per pixel to let them vectorize.
+static void store_pixels(RasterState const &state, float const *distances, uint32_t count, uint32_t x, uint32_t y) {
+	uint8_t *row = (uint8_t *)state.target.data + (std::ptrdiff_t)y * state.target.stride + x * get_pixel_size(state.target.format);
+	float band = state.band;
+	float scale = state.scale;
+
+	switch (state.target.format) {
+		case PixelFormat::distance_f32: {
+			float *out = (float *)row;
+			for (uint32_t i = 0; i < count; ++i) {
+				out[i] = std::clamp(distances[i], -band, band);
+			}
+			break;
+		}
+		case PixelFormat::distance_snorm8: {
+			int8_t *out = (int8_t *)row;
+			for (uint32_t i = 0; i < count; ++i) {
+				float value = std::clamp(distances[i], -band, band) * scale;
+				out[i] = (int8_t)(value + (value < 0 ? -0.5f : 0.5f));
+			}
+			break;
+		}
+		case PixelFormat::distance_unorm8: {
+			for (uint32_t i = 0; i < count; ++i) {
+				row[i] = (uint8_t)(std::clamp(distances[i], -band, band) * scale + 128.0f);
+			}
+			break;
+		}
+		case PixelFormat::alpha8: {
+			for (uint32_t i = 0; i < count; ++i) {
+				row[i] = coverage_to_unorm8(std::clamp(0.5f - distances[i] * scale, 0.0f, 1.0f));
+			}
+			break;
+		}
+		case PixelFormat::rgba8: {
+			for (uint32_t i = 0; i < count; ++i) {
+				uint8_t c = coverage_to_unorm8(std::clamp(0.5f - distances[i] * scale, 0.0f, 1.0f));
+				row[i*4 + 0] = c;
+				row[i*4 + 1] = c;
+				row[i*4 + 2] = c;
+				row[i*4 + 3] = 255;
+			}
+			break;
+		}
+		case PixelFormat::rgba8_lcd: {
+			constexpr uint32_t max_count = raster_root_size * 3 + raster_max_margin_samples * 2;
+			float coverage[max_count];
+			float filtered[max_count];
+
+			uint32_t subpixel_count = count * 3;
+			for (uint32_t i = 0; i < subpixel_count + state.margin_samples * 2; ++i) {
+				coverage[i] = std::clamp(0.5f - distances[i] * scale, 0.0f, 1.0f);
+			}
+
+			float const *subpixels = coverage;
+			if (state.target.lcd_filter) {
+				for (uint32_t i = 0; i < subpixel_count; ++i) {
+					float sum = 0;
+					for (uint32_t tap = 0; tap < 5; ++tap) {
+						sum += coverage[i + tap] * lcd_filter_weights[tap];
+					}
+					filtered[i] = std::min(sum, 1.0f);
+				}
+				subpixels = filtered;
+			}
+
+			// Left subpixel goes to r with rgb order, to b with bgr.
+			uint32_t first_channel = state.target.subpixel_order == SubpixelOrder::rgb ? 0 : 2;
+			int32_t channel_step = state.target.subpixel_order == SubpixelOrder::rgb ? 1 : -1;
+			for (uint32_t i = 0; i < count; ++i) {
+				for (uint32_t subpixel = 0; subpixel < 3; ++subpixel) {
+					row[i*4 + first_channel + subpixel * channel_step] = coverage_to_unorm8(subpixels[i*3 + subpixel]);
+				}
+				row[i*4 + 3] = 255;
+			}
+			break;
+		}
+	}
+}
+
+// program is specialized for the parent tile. If it is null, the object could
+// not be compiled and is evaluated directly.
+static void rasterize_tile(RasterState &state, Program const *program, uint32_t depth, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) {
+	// Big enough for samples of a leaf or a row of a root tile.
+	constexpr uint32_t max_count = std::max(
+		raster_leaf_size * (raster_leaf_size * raster_max_samples_per_pixel + raster_max_margin_samples * 2),
+		raster_root_size * raster_max_samples_per_pixel + raster_max_margin_samples * 2
+	);
+	float xs[max_count];
+	float ys[max_count];
+	float distances[max_count];
+
+	uint32_t width = x1 - x0;
+	uint32_t height = y1 - y0;
+	uint32_t row_sample_count = width * state.samples_per_pixel + state.margin_samples * 2;
+
+	// Converts the first row and copies it to the rest.
+	auto fill = [&](float value) {
+		std::fill_n(distances, row_sample_count, value);
+		store_pixels(state, distances, width, x0, y0);
+
+		std::size_t row_size = width * get_pixel_size(state.target.format);
+		uint8_t const *first_row = (uint8_t *)state.target.data + (std::ptrdiff_t)y0 * state.target.stride + x0 * get_pixel_size(state.target.format);
+		for (uint32_t y = y0 + 1; y < y1; ++y) {
+			memcpy((uint8_t *)first_row + (std::ptrdiff_t)(y - y0) * state.target.stride, first_row, row_size);
+		}
+	};
+
+	// Bounding box of the outermost samples of pixels at the corners of the tile.
+	// Viewport is affine, so it contains every sample in the tile.
+	Vector2 spread = abs(state.sample_step) * ((state.samples_per_pixel - 1) * 0.5f + state.margin_samples);
+	Vector2 corners[4] = {
+		pixel_center(state.viewport, x0,     y0),
+		pixel_center(state.viewport, x1 - 1, y0),
+		pixel_center(state.viewport, x0,     y1 - 1),
+		pixel_center(state.viewport, x1 - 1, y1 - 1),
+	};
+	Rect rect = {corners[0], corners[0]};
+	for (auto corner : corners) {
+		rect.min = {std::min(rect.min.x, corner.x), std::min(rect.min.y, corner.y)};
+		rect.max = {std::max(rect.max.x, corner.x), std::max(rect.max.y, corner.y)};
+	}
+	rect.min -= spread;
+	rect.max += spread;
+
+	if (get_gap(rect, state.bounds) >= state.band) {
+		fill(state.band);
+		return;
+	}
+
+	Interval interval;
+	Program *tile_program = nullptr;
+	if (program) {
+		tile_program = &state.context.tile_programs[depth];
+		interval = specialize_into(state.context, *program, rect, tile_program);
+	} else {
+		interval = evaluate_interval(state.context, state.scene, state.object, rect, state.precision);
+	}
+
+	if (interval.min >= state.band) {
+		fill(state.band);
+		return;
+	}
+	if (interval.max <= -state.band) {
+		fill(-state.band);
+		return;
+	}
+
+	if (width > raster_leaf_size || height > raster_leaf_size) {
+		uint32_t xm = width  > raster_leaf_size ? x0 + width  / 2 : x1;
+		uint32_t ym = height > raster_leaf_size ? y0 + height / 2 : y1;
+		rasterize_tile(state, tile_program, depth + 1, x0, y0, xm, ym);
+		if (xm != x1)              rasterize_tile(state, tile_program, depth + 1, xm, y0, x1, ym);
+		if (ym != y1)              rasterize_tile(state, tile_program, depth + 1, x0, ym, xm, y1);
+		if (xm != x1 && ym != y1)  rasterize_tile(state, tile_program, depth + 1, xm, ym, x1, y1);
+		return;
+	}
+
+	// Samples are placed relative to the center of their pixel, margin samples
+	// relative to the first or last pixel of the row.
+	uint32_t count = 0;
+	for (uint32_t y = y0; y < y1; ++y) {
+		for (uint32_t sample = 0; sample < row_sample_count; ++sample) {
+			int32_t index = (int32_t)sample - (int32_t)state.margin_samples;
+			int32_t pixel = index < 0 ? 0 : std::min(index / (int32_t)state.samples_per_pixel, (int32_t)width - 1);
+			float offset = (index - pixel * (int32_t)state.samples_per_pixel) - (state.samples_per_pixel - 1) * 0.5f;
+			Vector2 p = pixel_center(state.viewport, x0 + pixel, y) + state.sample_step * offset;
+			xs[count] = p.x;
+			ys[count] = p.y;
+			++count;
+		}
+	}
+
+	if (tile_program) {
+		evaluate_batch(state.context, *tile_program, {xs, count}, {ys, count}, {distances, count});
+	} else {
+		evaluate_batch(state.context, state.scene, state.object, {xs, count}, {ys, count}, {distances, count}, state.precision);
+	}
+
+	for (uint32_t y = y0; y < y1; ++y) {
+		store_pixels(state, distances + (y - y0) * row_sample_count, width, x0, y);
+	}
+}
+
+static RasterState make_raster_state(Scene const &scene, Object const &object, Rect bounds, Viewport const &viewport, RasterTarget const &target, EvalPrecision precision) {
+	RasterState state = {
+		.context = get_thread_context(),
+		.scene = scene,
+		.object = object,
+		.viewport = viewport,
+		.target = target,
+		.precision = precision,
+		.bounds = precision == EvalPrecision::bound ? everywhere : bounds,
+	};
+
+	float pixel_size = sqrtf(fabsf(viewport.x_axis.x * viewport.y_axis.y - viewport.x_axis.y * viewport.y_axis.x));
+
+	switch (target.format) {
+		case PixelFormat::distance_f32:
+			state.band = target.band;
+			state.scale = 1;
+			break;
+		case PixelFormat::distance_snorm8:
+			state.band = target.band;
+			state.scale = 127 / target.band;
+			break;
+		case PixelFormat::distance_unorm8:
+			state.band = target.band;
+			// Maps [-band, band] to [0.5, 255.5] before truncation.
+			state.scale = 127.5f / target.band;
+			break;
+		case PixelFormat::alpha8:
+		case PixelFormat::rgba8:
+			// Coverage is 0 or 1 beyond half a pixel from the edge.
+			state.band = pixel_size * 0.5f;
+			state.scale = 1 / pixel_size;
+			break;
+		case PixelFormat::rgba8_lcd:
+			// Every subpixel is a third of the pixel wide, its coverage is 0 or 1
+			// beyond half a subpixel from the edge.
+			state.band = pixel_size * (0.5f / 3);
+			state.scale = 3 / pixel_size;
+			break;
+	}
+
+	state.sample_step = viewport.x_axis;
+	if (target.format == PixelFormat::rgba8_lcd) {
+		state.samples_per_pixel = 3;
+		state.sample_step = viewport.x_axis * (1.0f / 3);
+		if (target.lcd_filter) {
+			state.margin_samples = 2;
+		}
+	}
+
+	if (state.context.tile_programs.size() < raster_max_depth) {
+		state.context.tile_programs.resize(raster_max_depth);
+	}
+
+	return state;
+}
+
+static uint32_t get_root_tile_count_x(Viewport const &viewport) {
+	return (viewport.width + raster_root_size - 1) / raster_root_size;
+}
+
+static uint32_t get_root_tile_count_y(Viewport const &viewport) {
+	return (viewport.height + raster_root_size - 1) / raster_root_size;
+}
+
+static void rasterize_root_tile(RasterState &state, Program const *program, uint32_t tile_index) {
+	uint32_t tile_count_x = get_root_tile_count_x(state.viewport);
+	uint32_t x = tile_index % tile_count_x * raster_root_size;
+	uint32_t y = tile_index / tile_count_x * raster_root_size;
+	rasterize_tile(state, program, 0, x, y, std::min(x + raster_root_size, state.viewport.width), std::min(y + raster_root_size, state.viewport.height));
+}
+
+// program is the compiled object, or null to evaluate the object directly.
+// bounds are get_bounds of the object.
+static void rasterize(Scene const &scene, Object const &object, Program const *program, Rect bounds, Viewport const &viewport, RasterTarget const &target, EvalPrecision precision) {
+	RasterState state = make_raster_state(scene, object, bounds, viewport, target, precision);
+
+	uint32_t tile_count = get_root_tile_count_x(viewport) * get_root_tile_count_y(viewport);
+	for (uint32_t tile_index = 0; tile_index < tile_count; ++tile_index) {
+		rasterize_root_tile(state, program, tile_index);
+	}
+}
+
+void rasterize(Scene const &scene, Object const &object, Viewport const &viewport, RasterTarget const &target, EvalPrecision precision) {
+	std::optional<Program> program = compile(scene, object, precision);
+	rasterize(scene, object, program ? &*program : nullptr, get_bounds(scene, object), viewport, target, precision);
+}
+
+// Tiles [begin, end) not taken yet, packed as begin | end << 32 to be updated
+// with a single compare exchange. Owner takes from the end, thieves take from
+// the begin, so they contend only for the last tile.
+struct alignas(64) TileRange {
+	std::atomic<uint64_t> range;
+
+	bool pop_back(uint32_t *tile_index) {
+		uint64_t current = range.load(std::memory_order_relaxed);
+		while (true) {
+			uint32_t begin = (uint32_t)current;
+			uint32_t end = (uint32_t)(current >> 32);
+			if (begin == end)
+				return false;
+			if (range.compare_exchange_weak(current, begin | (uint64_t)(end - 1) << 32, std::memory_order_relaxed)) {
+				*tile_index = end - 1;
+				return true;
+			}
+		}
+	}
+
+	bool pop_front(uint32_t *tile_index) {
+		uint64_t current = range.load(std::memory_order_relaxed);
+		while (true) {
+			uint32_t begin = (uint32_t)current;
+			uint32_t end = (uint32_t)(current >> 32);
+			if (begin == end)
+				return false;
+			if (range.compare_exchange_weak(current, (begin + 1) | (uint64_t)end << 32, std::memory_order_relaxed)) {
+				*tile_index = begin;
+				return true;
+			}
+		}
+	}
+};
+
+static void rasterize(Scene const &scene, Object const &object, Program const *program, Rect bounds, Viewport const &viewport, RasterTarget const &target, Executor &executor, EvalPrecision precision) {
+	uint32_t thread_count = std::max(executor.get_thread_count(), 1u);
+	uint32_t tile_count = get_root_tile_count_x(viewport) * get_root_tile_count_y(viewport);
+
+	std::vector<TileRange> ranges(thread_count);
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		uint64_t begin = (uint64_t)tile_count * i / thread_count;
+		uint64_t end = (uint64_t)tile_count * (i + 1) / thread_count;
+		ranges[i].range.store(begin | end << 32, std::memory_order_relaxed);
+	}
+
+	auto job = [&](uint32_t thread_index) {
+		RasterState state = make_raster_state(scene, object, bounds, viewport, target, precision);
+
+		uint32_t tile_index;
+		while (ranges[thread_index].pop_back(&tile_index)) {
+			rasterize_root_tile(state, program, tile_index);
+		}
+
+		// Ranges only shrink, so once every one is seen empty there is nothing left.
+		for (uint32_t i = 1; i < thread_count; ++i) {
+			TileRange &victim = ranges[(thread_index + i) % thread_count];
+			while (victim.pop_front(&tile_index)) {
+				rasterize_root_tile(state, program, tile_index);
+			}
+		}
+	};
+	executor.run({[](void *data, uint32_t thread_index) { (*(decltype(job) *)data)(thread_index); }, &job});
+}
+
+void rasterize(Scene const &scene, Object const &object, Viewport const &viewport, RasterTarget const &target, Executor &executor, EvalPrecision precision) {
+	std::optional<Program> program = compile(scene, object, precision);
+	rasterize(scene, object, program ? &*program : nullptr, get_bounds(scene, object), viewport, target, executor, precision);
+}
+
+PreparedScene prepare(Scene const &scene, EvalPrecision precision) {
+	PreparedScene prepared;
+	prepared.scene = &scene;
+	prepared.precision = precision;
+	invalidate(prepared);
+	return prepared;
+}
+
+void invalidate(PreparedScene &prepared) {
+	prepared.scale = prepared.scene->scale;
+	prepared.objects.clear();
+	prepared.objects.resize(prepared.scene->objects.size());
+}
+
+// Returns cached data of object, dropping all of it first if scene changed.
+static PreparedScene::PreparedObject &get_prepared_object(PreparedScene &prepared, uint32_t object_index) {
+	Scene const &scene = *prepared.scene;
+	if (prepared.scale.x != scene.scale.x || prepared.scale.y != scene.scale.y || prepared.objects.size() != scene.objects.size()) {
+		invalidate(prepared);
+	}
+	return prepared.objects[object_index];
+}
+
+Program const *get_program(PreparedScene &prepared, uint32_t object_index) {
+	Scene const &scene = *prepared.scene;
+
+	auto &object = get_prepared_object(prepared, object_index);
+	if (!object.compiled || (object.program && object.program->precision != prepared.precision)) {
+		object.program = compile(scene, scene.objects[object_index], prepared.precision);
+		object.compiled = true;
+	}
+
+	return object.program ? &*object.program : nullptr;
+}
+
+float evaluate(PreparedScene &prepared, uint32_t object_index, Vector2 point) {
+	if (auto program = get_program(prepared, object_index))
+		return evaluate(*program, point);
+	return evaluate(*prepared.scene, prepared.scene->objects[object_index], point, prepared.precision);
+}
+
+void evaluate_batch(PreparedScene &prepared, uint32_t object_index, std::span<Vector2 const> points, std::span<float> out) {
+	if (auto program = get_program(prepared, object_index)) {
+		evaluate_batch(*program, points, out);
+	} else {
+		evaluate_batch(*prepared.scene, prepared.scene->objects[object_index], points, out, prepared.precision);
+	}
+}
+
+void evaluate_batch(PreparedScene &prepared, uint32_t object_index, std::span<float const> xs, std::span<float const> ys, std::span<float> out) {
+	if (auto program = get_program(prepared, object_index)) {
+		evaluate_batch(*program, xs, ys, out);
+	} else {
+		evaluate_batch(*prepared.scene, prepared.scene->objects[object_index], xs, ys, out, prepared.precision);
+	}
+}
+
+Interval evaluate_interval(PreparedScene &prepared, uint32_t object_index, Rect rect) {
+	if (auto program = get_program(prepared, object_index))
+		return evaluate_interval(*program, rect);
+	return evaluate_interval(*prepared.scene, prepared.scene->objects[object_index], rect, prepared.precision);
+}
+
+bool is_inside(PreparedScene &prepared, uint32_t object_index, Vector2 point) {
+	Scene const &scene = *prepared.scene;
+	Object const &object = scene.objects[object_index];
+
+	if (!contains(get_bounds(prepared, object_index), point))
+		return false;
+
+	auto &prepared_object = get_prepared_object(prepared, object_index);
+	if (prepared_object.operation_costs.size() != object.operations.size()) {
+		prepared_object.operation_costs.resize(object.operations.size());
+		compute_operation_costs(scene, object, prepared_object.operation_costs.data());
+	}
+
+	EvalContext &context = get_thread_context();
+	reserve_is_inside(context, object);
+	return is_inside(context, scene, object, point, prepared_object.operation_costs.data(), prepared.precision);
+}
+
+Rect get_bounds(PreparedScene &prepared, uint32_t object_index) {
+	auto &object = get_prepared_object(prepared, object_index);
+	if (!object.bounds) {
+		object.bounds = get_bounds(*prepared.scene, prepared.scene->objects[object_index]);
+	}
+	return *object.bounds;
+}
+
+void rasterize(PreparedScene &prepared, uint32_t object_index, Viewport const &viewport, RasterTarget const &target) {
+	Program const *program = get_program(prepared, object_index);
+	rasterize(*prepared.scene, prepared.scene->objects[object_index], program, get_bounds(prepared, object_index), viewport, target, prepared.precision);
+}
+
+void rasterize(PreparedScene &prepared, uint32_t object_index, Viewport const &viewport, RasterTarget const &target, Executor &executor) {
+	Program const *program = get_program(prepared, object_index);
+	rasterize(*prepared.scene, prepared.scene->objects[object_index], program, get_bounds(prepared, object_index), viewport, target, executor, prepared.precision);
+}
+
+// Evaluators only use the scale of a scene, so an empty one stands in for the view.
+static Scene get_scene(SceneView const &view) {
+	Scene scene;
+	scene.scale = view.scale;
+	return scene;
+}
+
+// Reads object only if it is not the one read last time.
+static Object const &read_object(EvalContext &context, SceneView const &view, ObjectView object) {
+	if (context.view_object_id != view.id || context.view_object_data != object.primitives) {
+		read_object(object, context.view_object);
+		context.view_object_id = view.id;
+		context.view_object_data = object.primitives;
+		// Another object can be read into the same arrays.
+		context.costs_object = nullptr;
+	}
+	return context.view_object;
+}
+
+float evaluate(EvalContext &context, SceneView const &view, ObjectView object, Vector2 point, EvalPrecision precision) {
+	return evaluate(context, get_scene(view), read_object(context, view, object), point, precision);
+}
+
+void evaluate_batch(EvalContext &context, SceneView const &view, ObjectView object, std::span<Vector2 const> points, std::span<float> out, EvalPrecision precision) {
+	evaluate_batch(context, get_scene(view), read_object(context, view, object), points, out, precision);
+}
+
+Interval evaluate_interval(EvalContext &context, SceneView const &view, ObjectView object, Rect rect, EvalPrecision precision) {
+	return evaluate_interval(context, get_scene(view), read_object(context, view, object), rect, precision);
+}
+
+bool is_inside(EvalContext &context, SceneView const &view, ObjectView object, Vector2 point, EvalPrecision precision) {
+	return is_inside(context, get_scene(view), read_object(context, view, object), point, precision);
+}
+
+Rect get_bounds(EvalContext &context, SceneView const &view, ObjectView object) {
+	return get_bounds(context, get_scene(view), read_object(context, view, object));
+}
+
+std::optional<Program> compile(SceneView const &view, ObjectView object, EvalPrecision precision) {
+	return compile(get_scene(view), read_object(get_thread_context(), view, object), precision);
+}
+
+void rasterize(SceneView const &view, ObjectView object, Viewport const &viewport, RasterTarget const &target, EvalPrecision precision) {
+	rasterize(get_scene(view), read_object(get_thread_context(), view, object), viewport, target, precision);
+}
+
+void rasterize(SceneView const &view, ObjectView object, Viewport const &viewport, RasterTarget const &target, Executor &executor, EvalPrecision precision) {
+	rasterize(get_scene(view), read_object(get_thread_context(), view, object), viewport, target, executor, precision);
+}
+
+struct ThreadPool::State {
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable started;
+	std::condition_variable finished;
+	Job job;
+	uint64_t generation = 0;
+	uint32_t running_count = 0;
+	bool stopping = false;
+
+	void work(uint32_t thread_index);
+};
+
+ThreadPool::ThreadPool(uint32_t thread_count) : state(std::make_unique<State>()) {
+	if (thread_count == 0)
+		thread_count = std::thread::hardware_concurrency();
+	thread_count = std::max(thread_count, 1u);
+	state->threads.reserve(thread_count - 1);
+	for (uint32_t i = 1; i < thread_count; ++i) {
+		state->threads.emplace_back([state = state.get(), i] { state->work(i); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(state->mutex);
+		state->stopping = true;
+	}
+	state->started.notify_all();
+	for (auto &thread : state->threads) {
+		thread.join();
+	}
+}
+
+uint32_t ThreadPool::get_thread_count() {
+	return (uint32_t)state->threads.size() + 1;
+}
+
+void ThreadPool::run(Job job) {
+	{
+		std::lock_guard lock(state->mutex);
+		state->job = job;
+		state->running_count = (uint32_t)state->threads.size();
+		++state->generation;
+	}
+	state->started.notify_all();
+
+	job(0);
+
+	std::unique_lock lock(state->mutex);
+	state->finished.wait(lock, [&] { return state->running_count == 0; });
+	state->job = {};
+}
+
+void ThreadPool::State::work(uint32_t thread_index) {
+	uint64_t seen_generation = 0;
+	while (true) {
+		Job current_job;
+		{
+			std::unique_lock lock(mutex);
+			started.wait(lock, [&] { return stopping || generation != seen_generation; });
+			if (stopping)
+				return;
+			seen_generation = generation;
+			current_job = job;
+		}
+
+		current_job(thread_index);
+
+		{
+			std::lock_guard lock(mutex);
+			if (--running_count == 0) {
+				finished.notify_one();
+			}
+		}
+	}
+}
 
 #pragma pop_macro("defer")
 
@@ -0,0 +1,90 @@
+// Checks that evaluating through an EvalContext does not allocate once the
+// context has grown to fit the object.
+
+#define SDFD_IMPLEMENTATION
+#include "../sdfd.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+
+static size_t allocation_count = 0;
+
+void *operator new(size_t size) {
+	++allocation_count;
+	if (void *data = malloc(size ? size : 1))
+		return data;
+	throw std::bad_alloc();
+}
+
+// GCC inlines these into callers and then reports free() on a pointer from
+// operator new as a mismatch, even though the replaced new returns malloc'd memory.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *data) noexcept { free(data); }
+void operator delete(void *data, size_t) noexcept { free(data); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+int main() {
+	sdfd::Scene scene = {};
+	sdfd::Object object = {};
+
+	// Union of a row of circles, cut by a plane.
+	object.primitives.push_back(sdfd::plane_from_point_and_normal({0, 32}, {0, 1}));
+	for (uint32_t i = 0; i < 16; ++i) {
+		object.primitives.push_back(sdfd::Circle{.center = {i * 4.0f, 32}, .radius = 3});
+	}
+	object.operations.push_back({sdfd::Operation::Kind::min_range, {
+		sdfd::object_primitive_index(1),
+		sdfd::object_primitive_index(16),
+	}});
+	object.operations.push_back({sdfd::Operation::Kind::max, {
+		sdfd::object_operation_index(0),
+		sdfd::object_primitive_index(0),
+	}});
+
+	sdfd::Vector2 points[256];
+	for (uint32_t i = 0; i < 256; ++i) {
+		points[i] = {(i % 16) * 4.0f + 0.5f, (i / 16) * 4.0f + 0.5f};
+	}
+	float distances[256];
+	bool insides[256];
+
+	sdfd::EvalContext context;
+	auto evaluate_all = [&] {
+		float sum = 0;
+		for (auto point : points) {
+			sum += sdfd::evaluate(context, scene, object, point);
+			sum += sdfd::is_inside(context, scene, object, point);
+		}
+		sdfd::evaluate_batch(context, scene, object, points, distances);
+		sdfd::is_inside_batch(context, scene, object, points, insides);
+		return sum;
+	};
+
+	int failures = 0;
+
+	// Uniform scale evaluates circles, other scales evaluate ellipses.
+	for (sdfd::Vector2 scale : {sdfd::Vector2{1, 1}, sdfd::Vector2{2, 1}}) {
+		scene.scale = scale;
+
+		// Grows the context.
+		evaluate_all();
+
+		size_t before = allocation_count;
+		for (uint32_t i = 0; i < 4; ++i) {
+			evaluate_all();
+		}
+		size_t count = allocation_count - before;
+
+		printf("scale {%g, %g}: %zu allocations\n", scale.x, scale.y, count);
+		if (count != 0)
+			++failures;
+	}
+
+	return failures != 0;
+}
@@ -0,0 +1,112 @@
+// Checks the error of EvalPrecision::fast and the guarantees of
+// EvalPrecision::bound against distance(Ellipse) on random ellipses.
+
+#define SDFD_IMPLEMENTATION
+#include "../sdfd.hpp"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+static uint32_t random_state = 1;
+
+// Uniform in [min, max).
+static float random_float(float min, float max) {
+	random_state = random_state * 1664525u + 1013904223u;
+	return min + (random_state >> 8) * (1.0f / (1 << 24)) * (max - min);
+}
+
+static int failures = 0;
+
+// Documented in distance_fast.
+static float get_fast_tolerance(sdfd::Ellipse e, float distance) {
+	return 2e-5f * (std::max(1.0f, fabsf(distance)) + std::max(e.radius.x, e.radius.y));
+}
+
+static void check(bool ok, char const *what, sdfd::Ellipse e, sdfd::Vector2 p, float expected, float got) {
+	if (ok)
+		return;
+	if (++failures <= 10) {
+		printf("%s: ellipse {%g, %g} {%g, %g} point {%g, %g}: expected %g, got %g\n",
+			what, e.center.x, e.center.y, e.radius.x, e.radius.y, p.x, p.y, expected, got);
+	}
+}
+
+int main() {
+	float max_fast_error = 0;
+	float max_fast_error_near = 0;
+
+	for (uint32_t i = 0; i < 100000; ++i) {
+		// Radii from 0.5 to 500 pixels, up to 32 times longer than wide.
+		float small_radius = random_float(0.5f, 64);
+		float large_radius = std::min(small_radius * random_float(1, 32), 500.0f);
+		sdfd::Ellipse e = {
+			.center = {random_float(-100, 100), random_float(-100, 100)},
+			.radius = i % 2 ? sdfd::Vector2{large_radius, small_radius} : sdfd::Vector2{small_radius, large_radius},
+		};
+
+		// Half of the points are within a pixel of the edge, others anywhere up
+		// to twice the large radius away from the center.
+		sdfd::Vector2 p;
+		if (i % 4 < 2) {
+			float angle = random_float(-3.1415927f, 3.1415927f);
+			p = e.center + e.radius * sdfd::Vector2{cosf(angle), sinf(angle)};
+		} else {
+			p = e.center + sdfd::Vector2{random_float(-2, 2), random_float(-2, 2)} * large_radius;
+		}
+		float exact = sdfd::distance(e, p);
+		if (i % 4 == 0) {
+			// Moves it up to a pixel off the edge.
+			p += sdfd::Vector2{random_float(-1, 1), random_float(-1, 1)};
+			exact = sdfd::distance(e, p);
+		}
+
+		float fast = sdfd::distance_fast(e, p);
+		float fast_error = fabsf(fast - exact);
+		max_fast_error = std::max(max_fast_error, fast_error / get_fast_tolerance(e, exact));
+		if (fabsf(exact) < 1)
+			max_fast_error_near = std::max(max_fast_error_near, fast_error);
+		check(fast_error < get_fast_tolerance(e, exact), "fast", e, p, exact, fast);
+		check(fabsf(exact) >= 1 || fabsf(fast - exact) < 1 / 64.0f, "fast near the edge", e, p, exact, fast);
+
+		// Never bigger in magnitude than the distance, with room for rounding
+		// of both. Signs are not compared right at the edge, where both are about 0.
+		float bound = sdfd::distance_bound(e, p);
+		check(fabsf(bound) <= fabsf(exact) * (1 + 1e-5f) + 1e-4f, "bound magnitude", e, p, exact, bound);
+		check(fabsf(exact) < 1e-3f || (bound < 0) == (exact < 0), "bound sign", e, p, exact, bound);
+
+		// Changes no faster than the point moves.
+		sdfd::Vector2 step = {random_float(-1, 1), random_float(-1, 1)};
+		sdfd::Vector2 q = p + step * random_float(0, large_radius);
+		float bound_q = sdfd::distance_bound(e, q);
+		float moved = length(q - p);
+		check(fabsf(bound_q - bound) <= moved * (1 + 1e-5f) + 1e-4f * std::max(1.0f, fabsf(bound)), "bound lipschitz", e, q, bound + moved, bound_q);
+	}
+
+	// Batch evaluators run fast on SIMD lanes, a circle in a scene with
+	// non-uniform scale is an ellipse.
+	for (uint32_t i = 0; i < 1000; ++i) {
+		sdfd::Scene scene = {};
+		scene.scale = {random_float(0.25f, 4), random_float(0.25f, 4)};
+		sdfd::Object object = {};
+		object.primitives.push_back(sdfd::Circle{.center = {random_float(-10, 10), random_float(-10, 10)}, .radius = random_float(0.5f, 16)});
+
+		sdfd::Vector2 points[64];
+		for (auto &point : points) {
+			point = {random_float(-40, 40), random_float(-40, 40)};
+		}
+		float distances[64];
+		sdfd::evaluate_batch(scene, object, points, distances, sdfd::EvalPrecision::fast);
+
+		sdfd::Ellipse e = {.center = scene.scale * object.primitives[0].circle.center, .radius = scene.scale * object.primitives[0].circle.radius};
+		for (uint32_t j = 0; j < 64; ++j) {
+			sdfd::Vector2 p = points[j];
+			float exact = sdfd::distance(e, p);
+			check(fabsf(distances[j] - exact) < get_fast_tolerance(e, exact), "fast batch", e, p, exact, distances[j]);
+		}
+	}
+
+	printf("fast: largest error %g of tolerance, %g pixels within a pixel of the edge\n", max_fast_error, max_fast_error_near);
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,138 @@
+// Sweeps the fast math approximations over their documented ranges on every
+// lane type the cpu supports and checks their errors against libm.
+
+#define SDFD_IMPLEMENTATION
+#include "../sdfd.hpp"
+
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+
+enum class Function {
+	acos,
+	cos,
+	sin,
+	cbrt,
+};
+
+template <class F>
+static void evaluate(Function function, float const *in, float *out, size_t count) {
+	switch (function) {
+		case Function::acos: sdfd::map_lanes<F>(out, count, [](F x) { return sdfd::fast_acos(x); }, in); break;
+		case Function::cos:  sdfd::map_lanes<F>(out, count, [](F x) { return sdfd::fast_cos(x); },  in); break;
+		case Function::sin:  sdfd::map_lanes<F>(out, count, [](F x) { return sdfd::fast_sin(x); },  in); break;
+		case Function::cbrt: sdfd::map_lanes<F>(out, count, [](F x) { return sdfd::fast_cbrt(x); }, in); break;
+	}
+}
+
+// Instantiated like the kernels, so that wider lane types get compiled for their instruction set.
+static void evaluate_x1(Function function, float const *in, float *out, size_t count) { evaluate<sdfd::F32x1>(function, in, out, count); }
+#if SDFD_SIMD_X86
+static void evaluate_x4(Function function, float const *in, float *out, size_t count) { evaluate<sdfd::F32x4>(function, in, out, count); }
+SDFD_TARGET_AVX2 SDFD_FLATTEN static void evaluate_x8(Function function, float const *in, float *out, size_t count) { evaluate<sdfd::F32x8>(function, in, out, count); }
+SDFD_TARGET_AVX512 SDFD_FLATTEN static void evaluate_x16(Function function, float const *in, float *out, size_t count) { evaluate<sdfd::F32x16>(function, in, out, count); }
+#endif
+
+struct Width {
+	char const *name;
+	void (*evaluate)(Function function, float const *in, float *out, size_t count);
+	bool supported;
+};
+
+struct Sweep {
+	char const *name;
+	Function function;
+	double (*reference)(double x);
+
+	// Inputs and the largest error allowed for them, as documented next to the function.
+	std::vector<float> inputs;
+	bool relative;
+	double max_error;
+};
+
+// count points evenly spaced from min to max, both included.
+static std::vector<float> linear_inputs(float min, float max, uint32_t count) {
+	std::vector<float> result;
+	for (uint32_t i = 0; i < count; ++i) {
+		result.push_back(min + (max - min) * ((double)i / (count - 1)));
+	}
+	return result;
+}
+
+// Every normal float with the lowest 8 bits of the mantissa cleared, both signs.
+static std::vector<float> normal_inputs() {
+	std::vector<float> result;
+	for (uint32_t bits = 0x00800000; bits < 0x7f800000; bits += 0x100) {
+		float x;
+		memcpy(&x, &bits, sizeof(x));
+		result.push_back(x);
+		result.push_back(-x);
+	}
+	return result;
+}
+
+int main() {
+	Width widths[] = {
+		{"x1", evaluate_x1, true},
+	#if SDFD_SIMD_X86
+		{"x4", evaluate_x4, true},
+		{"x8", evaluate_x8, sdfd::cpu_supports_avx2()},
+		{"x16", evaluate_x16, sdfd::cpu_supports_avx512f()},
+	#endif
+	};
+
+	Sweep sweeps[] = {
+		{"acos", Function::acos, ::acos, linear_inputs(-1, 1, 1 << 20), false, 7e-5},
+		{"cos", Function::cos, ::cos, linear_inputs(0, 3.14159265f / 3, 1 << 20), false, 6e-7},
+		{"sin", Function::sin, ::sin, linear_inputs(0, 3.14159265f / 3, 1 << 20), false, 6e-7},
+		{"cbrt", Function::cbrt, ::cbrt, normal_inputs(), true, 2e-6},
+	};
+
+	int failures = 0;
+	std::vector<float> out;
+	for (auto &width : widths) {
+		if (!width.supported) {
+			printf("%s: not supported by the cpu, skipped\n", width.name);
+			continue;
+		}
+
+		for (auto &sweep : sweeps) {
+			out.resize(sweep.inputs.size());
+			width.evaluate(sweep.function, sweep.inputs.data(), out.data(), sweep.inputs.size());
+
+			double max_error = 0;
+			float worst_input = 0;
+			for (size_t i = 0; i < sweep.inputs.size(); ++i) {
+				double expected = sweep.reference(sweep.inputs[i]);
+				double error = fabs(out[i] - expected);
+				if (sweep.relative)
+					error /= fabs(expected);
+				// Also catches NaN.
+				if (!(error <= max_error)) {
+					max_error = error;
+					worst_input = sweep.inputs[i];
+				}
+			}
+
+			bool ok = max_error < sweep.max_error;
+			printf("%s %s: %s error %.3g at %.9g, allowed %.3g%s\n", width.name, sweep.name, sweep.relative ? "relative" : "absolute",
+				max_error, worst_input, sweep.max_error, ok ? "" : ", FAILED");
+			if (!ok)
+				++failures;
+		}
+
+		// Zero and denormals, which cube root does not handle exactly.
+		float tiny[] = {0, -0.0f, FLT_TRUE_MIN, -FLT_TRUE_MIN, FLT_MIN / 2, -FLT_MIN / 2};
+		float tiny_out[6];
+		width.evaluate(Function::cbrt, tiny, tiny_out, 6);
+		for (uint32_t i = 0; i < 6; ++i) {
+			if (!(fabs(tiny_out[i] - cbrt((double)tiny[i])) < 1e-12)) {
+				printf("%s cbrt: %g for %g, FAILED\n", width.name, tiny_out[i], tiny[i]);
+				++failures;
+			}
+		}
+	}
+
+	return failures != 0;
+}
@@ -0,0 +1,130 @@
+// Checks that loading truncated or corrupted scenes fails or yields a scene
+// that can be stored again, without allocating more than the input justifies.
+
+#define SDFD_IMPLEMENTATION
+#include "../sdfd.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+static size_t largest_allocation = 0;
+
+void *operator new(size_t size) {
+	if (size > largest_allocation)
+		largest_allocation = size;
+	if (void *data = malloc(size ? size : 1))
+		return data;
+	throw std::bad_alloc();
+}
+
+// See alloc.cpp.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *data) noexcept { free(data); }
+void operator delete(void *data, size_t) noexcept { free(data); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+int main() {
+	sdfd::Scene scene = {};
+	for (uint32_t i = 0; i < 3; ++i) {
+		sdfd::Object object = {};
+		object.primitives.push_back(sdfd::plane_from_point_and_normal({0, 32}, {0, 1}));
+		object.primitives.push_back(sdfd::Circle{.center = {i * 4.0f, 32}, .radius = 3});
+		object.primitives.push_back(sdfd::Circle{.center = {i * 4.0f, 40}, .radius = 2});
+		object.primitives.push_back(1.5f);
+		object.operations.push_back({sdfd::Operation::Kind::min_range, {
+			sdfd::object_primitive_index(1),
+			sdfd::object_primitive_index(2),
+		}});
+		object.operations.push_back({sdfd::Operation::Kind::neg, {
+			sdfd::object_primitive_index(3),
+		}});
+		object.operations.push_back({sdfd::Operation::Kind::max_neg, {
+			sdfd::object_operation_index(0),
+			sdfd::object_primitive_index(0),
+		}});
+		scene.objects.push_back(object);
+	}
+	scene.primitives.push_back(sdfd::Circle{.center = {8, 8}, .radius = 4});
+
+	std::vector<uint8_t> valid;
+	if (!sdfd::store_to_memory(scene, valid) || !sdfd::load_from_memory(valid)) {
+		printf("valid scene did not round trip\n");
+		return 1;
+	}
+
+	// Anything more than a few times the input means a count was trusted.
+	size_t allocation_limit = 64 * valid.size();
+	uint32_t failures = 0;
+	uint32_t loaded_count = 0;
+	std::vector<uint8_t> stored;
+	// Returns whether data loaded.
+	auto check = [&](std::vector<uint8_t> const &data, char const *what, size_t at) {
+		largest_allocation = 0;
+		auto loaded = sdfd::load_from_memory(data);
+		if (largest_allocation > allocation_limit) {
+			printf("%s at %zu: allocated %zu bytes from %zu\n", what, at, largest_allocation, data.size());
+			++failures;
+		}
+		if (loaded) {
+			++loaded_count;
+			if (!sdfd::store_to_memory(*loaded, stored)) {
+				printf("%s at %zu: loaded scene can not be stored\n", what, at);
+				++failures;
+			}
+		}
+		return loaded.has_value();
+	};
+
+	for (size_t size = 0; size < valid.size(); ++size) {
+		std::vector<uint8_t> data(valid.begin(), valid.begin() + size);
+		if (check(data, "truncated", size)) {
+			printf("truncated to %zu of %zu bytes: loaded\n", size, valid.size());
+			++failures;
+		}
+	}
+
+	uint8_t const replacements[] = {0x00, 0x01, 0x7f, 0x80, 0xff};
+	for (size_t i = 0; i < valid.size(); ++i) {
+		for (uint8_t replacement : replacements) {
+			std::vector<uint8_t> data = valid;
+			data[i] = replacement;
+			check(data, "byte replaced", i);
+		}
+	}
+
+	// Counts right after the header and offsets.
+	size_t count_offsets[] = {
+		4 + sizeof(uint16_t),
+		4 + sizeof(uint16_t) + sizeof(uint32_t) + (scene.objects.size() + 1) * sizeof(uint64_t),
+	};
+	for (size_t offset : count_offsets) {
+		std::vector<uint8_t> data = valid;
+		memset(data.data() + offset, 0xff, sizeof(uint32_t));
+		check(data, "count set to max", offset);
+	}
+
+	uint32_t random = 1;
+	auto next_random = [&] {
+		random = random * 1664525 + 1013904223;
+		return random >> 8;
+	};
+	for (uint32_t i = 0; i < 20000; ++i) {
+		std::vector<uint8_t> data = valid;
+		uint32_t byte_count = 1 + next_random() % 4;
+		size_t first = next_random() % data.size();
+		for (uint32_t j = 0; j < byte_count; ++j) {
+			data[next_random() % data.size()] = (uint8_t)next_random();
+		}
+		check(data, "random bytes", first);
+	}
+
+	printf("%u corrupted buffers loaded, %u failures\n", loaded_count, failures);
+	return failures != 0;
+}